@@ -11,6 +11,7 @@
 #include <chrono>
 #include <algorithm>
 #include <future>
+#include "../Sum-Convert/PerfCounters.h"
 
 using namespace std;
 
@@ -112,9 +113,13 @@ int main() {
     Data data(N, 0);
 
     // try STL's sort first for comparison
+    PerfRegion stlCounts("std::sort"), bitonicCounts("Bitonic::sort");
     fillRandom(data, 0, N);
     auto start1 = chrono::steady_clock::now();
-    sort(data.begin(), data.end());
+    {
+        PerfScope scope(stlCounts);
+        sort(data.begin(), data.end());
+    }
     // for (int i = 0; i < N; i++) {
     //     cout << data[i] << " ";
     // }
@@ -128,7 +133,10 @@ int main() {
     auto start = chrono::steady_clock::now();
 
     Bitonic<Data> bitonic(&data);
-    bitonic.sort();
+    {
+        PerfScope scope(bitonicCounts);
+        bitonic.sort();
+    }
 
     // stop timer
     auto end = chrono::steady_clock::now();
@@ -144,5 +152,7 @@ int main() {
         check = elem;
     }
     cout << "in " << elapsed << "ms" << endl;
+    stlCounts.print(cout, N);
+    bitonicCounts.print(cout, N);
     return 0;
 }
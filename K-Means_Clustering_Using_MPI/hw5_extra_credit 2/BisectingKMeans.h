@@ -0,0 +1,419 @@
+/**
+ * @file BisectingKMeans.h - A subclass of KMeansMPI that builds k clusters by repeated 2-means
+ *
+ * Flat k-means costs O(n k d) per generation, which is out of reach at k = 10^4.
+ * Bisecting k-means starts from one cluster holding every point and repeatedly
+ * splits the cluster with the highest SSE (or the most weight) into two with a
+ * 2-means fit, until there are k leaves. Each split only touches the points of
+ * the cluster being split, so one level of the tree costs O(n d) and the whole
+ * fit about O(n d log k).
+ *
+ * Splits are independent tasks. ROOT hands out up to one per rank per round:
+ * the highest-priority leaves are scattered to the ranks, each rank runs a
+ * single-process KMeansMPI(2) over its leaf's points, and ROOT gathers the two
+ * child centroids and the side of the split each point fell on. Taking a round's
+ * leaves together, rather than strictly one at a time, is the only departure
+ * from the greedy order.
+ *
+ * The splits form a binary tree whose leaves are the clusters. getClusters,
+ * predict and the saved model use the leaves as a flat model. predictTree
+ * descends the tree instead, choosing the nearer child at each node. This is
+ * O(d log k) per point. It is approximate: the leaf it reaches is not always
+ * the nearest centroid.
+ */
+
+#pragma once
+#include <algorithm>
+#include <queue>
+#include "KMeansMPI.h"
+#include "SharedMemoryCommunicator.h"
+using namespace std;
+
+/**
+ * @class BisectingKMeans
+ * @brief Hierarchical k-means: a tree of 2-means splits with k leaves.
+ */
+class BisectingKMeans : public KMeansMPI {
+public:
+    /// Which leaf is split next
+    enum SplitRule {
+        SPLIT_HIGHEST_SSE,  ///< The leaf with the largest sum of squared distances
+        SPLIT_LARGEST       ///< The leaf with the most weight (points)
+    };
+
+    /// 2-means fits tried per split; the one with the lowest SSE is kept
+    static const int SPLIT_TRIALS = 3;
+
+    /**
+     * @struct Node
+     * @brief A split (two children) or a leaf (one of the clusters).
+     */
+    struct Node {
+        int left = -1;   ///< Child holding the points nearer its centroid, or -1 for a leaf
+        int right = -1;  ///< The other child, or -1 for a leaf
+        int leaf = -1;   ///< Cluster index of a leaf, or -1 for a split
+    };
+
+    /**
+     * @param k the number of leaves (clusters) to grow
+     */
+    explicit BisectingKMeans(int k) : KMeansMPI(k), targetK(k) {}
+
+    /**
+     * @param rule how the next leaf to split is chosen; must be set at ROOT
+     */
+    void setSplitRule(SplitRule rule) {
+        splitRule = rule;
+    }
+
+    /**
+     * @return the nodes of the last fit's tree; node 0 is the root
+     */
+    const vector<Node>& getTree() const {
+        return tree;
+    }
+
+    /**
+     * @return the centroid of every tree node, nodes x d, row-major
+     */
+    const unsigned char* getNodeCentroids() const {
+        return nodeCentroids.data();
+    }
+
+    /**
+     * @brief Labels points by descending the tree, O(d log k) per point.
+     *
+     * Each step moves to the nearer of two children (ties go left), so the label
+     * is the leaf of the point's path. It can differ from predict's nearest leaf.
+     * Available on every rank.
+     *
+     * @param points n row-major points of d values each
+     * @param n Number of points
+     * @param labels Output, the leaf (cluster) index of each point
+     * @pre fit or fitWork has completed
+     */
+    void predictTree(const unsigned char* points, int n, int* labels) const {
+        for (int i = 0; i < n; i++) {
+            const unsigned char* point = points + (size_t)i * d;
+            int node = 0;
+            while (tree[node].leaf < 0) {
+                int left = tree[node].left, right = tree[node].right;
+                unsigned int toLeft = squaredDistance(point, &nodeCentroids[(size_t)left * d], d);
+                unsigned int toRight = squaredDistance(point, &nodeCentroids[(size_t)right * d], d);
+                node = toRight < toLeft ? right : left;
+            }
+            labels[i] = tree[node].leaf;
+        }
+    }
+
+    /**
+     * Per-process work for fitting: take split tasks from ROOT until it has k leaves.
+     * @param rank Rank of this process (or thread) within the communicator
+     * @post on every rank, k is the number of leaves grown (less than requested only
+     *       if the data ran out of distinct points) and the tree and model are set
+     */
+    void fitWork(int rank) override {
+        profiler.reset();
+        profiler.setCounting(countEvents);
+        {
+            KMeansProfiler::Scope scope(profiler, Phase::PARTITION_COLORS);
+            broadcastSize();
+            proccesses = comm->size();
+            counts.resize(proccesses);
+            displs.resize(proccesses);
+        }
+        if (rank == ROOT)
+            plantRoot();
+
+        // One generation per round of splits; each round ends by handing out the next
+        int tasks = profiled(Phase::PARTITION_COLORS, [&] { return scatterTasks(rank); });
+        while (tasks > 0) {
+            profiler.beginGeneration();
+            KLOG_DEBUG("splitting " << tasks << " leaves");
+            profiled(Phase::UPDATE_CLUSTERS, [&] { splitTask(); });
+            profiled(Phase::COMBINE_CLUSTERS, [&] { gatherSplits(rank, tasks); });
+            tasks = profiled(Phase::PARTITION_COLORS, [&] { return scatterTasks(rank); });
+        }
+        profiler.beginFinal();
+        if (rank == ROOT)
+            numberLeaves();
+        profiled(Phase::DISTRIBUTE_CENTROIDS, [&] { distributeTree(); });
+
+        clusters.resize(k);
+        centroidData.resize((size_t)k * d);
+        for (int j = 0; j < k; j++)
+            copy(&nodeCentroids[(size_t)leafNodes[j] * d], &nodeCentroids[(size_t)(leafNodes[j] + 1) * d],
+                 centroidData.begin() + (size_t)j * d);
+        model = CentroidModel(centroidData.data(), k, d);
+        latency.clear();
+        if (!profileReport.empty())
+            profiler.writeReport(profileReport, *comm, ROOT);
+    }
+
+protected:
+    /**
+     * @class Splitter
+     * @brief The 2-means of one split: a KMeansMPI on a single-rank communicator.
+     */
+    class Splitter : public KMeansMPI {
+    public:
+        Splitter() : KMeansMPI(2), group(1), self(group, 0) {
+            setCommunicator(self);
+        }
+
+    protected:
+        /// Two centroids never pay for the sparse path or its density allreduce
+        void chooseRepresentation() override {
+            sparse = false;
+        }
+
+    private:
+        SharedMemoryGroup group;
+        SharedMemoryCommunicator self;
+    };
+
+    /**
+     * @struct Leaf
+     * @brief ROOT's bookkeeping for a node that has not been split.
+     */
+    struct Leaf {
+        vector<int> members;   ///< Indices of the node's points in elements
+        double sse = 0;        ///< Weighted sum of squared distances to the node's centroid
+        long long weight = 0;  ///< Total weight of the members
+    };
+
+    int targetK;                             /// Leaves requested
+    SplitRule splitRule = SPLIT_HIGHEST_SSE; /// How ROOT picks the next leaf
+    vector<Node> tree;                       /// The splits and leaves of the last fit
+    vector<unsigned char> nodeCentroids;     /// Centroid of every node (nodes x d)
+    vector<int> leafNodes;                   /// Node of each cluster
+    vector<Leaf> leaves;                     /// Per node, its points while it is a leaf (ROOT)
+    priority_queue<pair<double, int>> pending; /// Splittable leaves by priority (ROOT)
+    vector<int> taskNodes;                   /// Node each rank is splitting this round (ROOT)
+    vector<unsigned char> taskPoints;        /// Points of the leaf this rank is splitting
+    vector<int> taskWeights;                 /// Their weights, when weighted
+    int taskSize = 0;                        /// Number of points in this rank's task
+    vector<unsigned char> staging;           /// Points of all tasks, packed at ROOT for scatterv
+    vector<int> stagingWeights;              /// Their weights, when weighted (ROOT)
+    vector<unsigned char> sides;             /// 0 or 1 per task point: which child it joins
+    vector<unsigned char> allSides;          /// Every task's sides, gathered at ROOT
+    vector<unsigned char> children;          /// This task's two child centroids (2 x d)
+    vector<unsigned char> allChildren;       /// Every rank's child centroids (ROOT)
+    int leafCount = 0;                       /// Leaves grown so far (ROOT)
+
+    /**
+     * @brief Starts the tree at ROOT with one leaf holding every point.
+     */
+    void plantRoot() {
+        tree.assign(1, Node());
+        leaves.assign(1, Leaf());
+        nodeCentroids.assign(d, 0);
+        pending = {};
+        leafCount = 1;
+        Leaf& root = leaves[0];
+        root.members.resize(nColors);
+        iota(root.members.begin(), root.members.end(), 0);
+
+        vector<long long> sum(d, 0);
+        for (int i = 0; i < nColors; i++) {
+            long long w = weightOf(i);
+            root.weight += w;
+            for (int t = 0; t < d; t++)
+                sum[t] += w * elements[(size_t)i * d + t];
+        }
+        for (int t = 0; root.weight > 0 && t < d; t++)
+            nodeCentroids[t] = (unsigned char)((sum[t] + root.weight / 2) / root.weight);
+        for (int i = 0; i < nColors; i++)
+            root.sse += (double)weightOf(i) * squaredDistance(elements + (size_t)i * d, nodeCentroids.data(), d);
+        offer(0);
+    }
+
+    /**
+     * @param i index of a point in elements (ROOT)
+     * @return its weight
+     */
+    long long weightOf(int i) const {
+        return weighted ? elementWeights[i] : 1;
+    }
+
+    /**
+     * @brief Queues a leaf for splitting if it has anything to split.
+     * @param node a leaf node
+     */
+    void offer(int node) {
+        const Leaf& leaf = leaves[node];
+        if (leaf.members.size() < 2 || leaf.sse <= 0)
+            return;
+        pending.push({splitRule == SPLIT_LARGEST ? (double)leaf.weight : leaf.sse, node});
+    }
+
+    /**
+     * @brief Sends each rank the points of the leaf it is to split this round.
+     *
+     * ROOT takes up to one leaf per rank from the queue, never more than the leaves
+     * still missing. Tasks go to the lowest ranks; the rest get zero points.
+     * @param rank The rank of the current process.
+     * @return number of tasks this round, on every rank; 0 when the tree is done
+     */
+    int scatterTasks(int rank) {
+        if (rank == ROOT) {
+            taskNodes.clear();
+            while ((int)taskNodes.size() < proccesses && leafCount + (int)taskNodes.size() < targetK && !pending.empty()) {
+                taskNodes.push_back(pending.top().second);
+                pending.pop();
+            }
+            int tasks = taskNodes.size();
+            int total = 0;
+            for (int z = 0; z < proccesses; z++) {
+                counts[z] = z < tasks ? leaves[taskNodes[z]].members.size() : 0;
+                displs[z] = total;
+                total += counts[z];
+            }
+            staging.resize((size_t)total * d);
+            stagingWeights.resize(weighted ? total : 0);
+            for (int z = 0; z < tasks; z++) {
+                const vector<int>& members = leaves[taskNodes[z]].members;
+                for (size_t m = 0; m < members.size(); m++) {
+                    copy(elements + (size_t)members[m] * d, elements + (size_t)(members[m] + 1) * d,
+                         staging.begin() + (size_t)(displs[z] + m) * d);
+                    if (weighted)
+                        stagingWeights[displs[z] + m] = elementWeights[members[m]];
+                }
+            }
+        }
+        // Every leaf offered for splitting has at least two points, so no task is empty
+        comm->broadcast(counts.data(), proccesses, sizeof(int), ROOT);
+        int tasks = proccesses - count(counts.begin(), counts.end(), 0);
+        if (tasks == 0)
+            return 0;
+
+        taskSize = counts[rank];
+        taskPoints.resize((size_t)taskSize * d);
+        profiler.addBytes(Phase::PARTITION_COLORS, (double)taskSize * d);
+        comm->scatterv(staging.data(), counts.data(), displs.data(), taskPoints.data(), taskSize, d, ROOT);
+        taskWeights.resize(weighted ? taskSize : 0);
+        if (weighted)
+            comm->scatterv(stagingWeights.data(), counts.data(), displs.data(), taskWeights.data(), taskSize, sizeof(int), ROOT);
+        return tasks;
+    }
+
+    /**
+     * @brief Splits this rank's leaf with the best of SPLIT_TRIALS 2-means fits.
+     *
+     * A trial that leaves one side empty (all its seeds on identical points) does
+     * not count as a split. If no trial separates the points, every point stays
+     * on side 0 and ROOT closes the leaf.
+     */
+    void splitTask() {
+        sides.assign(taskSize, 0);
+        children.assign((size_t)2 * d, 0);
+        if (taskSize < 2)
+            return;
+        double best = -1;
+        for (int trial = 0; trial < SPLIT_TRIALS; trial++) {
+            splitter.fit(taskPoints.data(), taskSize, d, weighted ? taskWeights.data() : nullptr);
+            const Clusters& halves = splitter.getClusters();
+            if (halves[0].elements.empty() || halves[1].elements.empty())
+                continue;
+            if (best < 0 || splitter.getInertia() < best) {
+                best = splitter.getInertia();
+                for (int side = 0; side < 2; side++) {
+                    copy(halves[side].centroid.begin(), halves[side].centroid.end(), children.begin() + (size_t)side * d);
+                    for (int i : halves[side].elements)
+                        sides[i] = side;
+                }
+            }
+        }
+    }
+
+    /**
+     * @brief Gathers every task's sides and children at ROOT and grows the tree.
+     * @param rank The rank of the current process.
+     * @param tasks Number of tasks this round
+     */
+    void gatherSplits(int rank, int tasks) {
+        if (rank == ROOT) {
+            allChildren.resize((size_t)proccesses * 2 * d);
+            allSides.resize(displs[proccesses - 1] + counts[proccesses - 1]);
+        }
+        profiler.addBytes(Phase::COMBINE_CLUSTERS, 2.0 * d + taskSize);
+        comm->gather(children.data(), 2 * d, allChildren.data(), 1, ROOT);
+        comm->gatherv(sides.data(), taskSize, allSides.data(), counts.data(), displs.data(), 1, ROOT);
+        if (rank != ROOT)
+            return;
+
+        for (int z = 0; z < tasks; z++) {
+            int parent = taskNodes[z];
+            const unsigned char* side = &allSides[displs[z]];
+            if (find(side, side + counts[z], 1) == side + counts[z]) {
+                KLOG_DEBUG("leaf " << parent << " cannot be split");
+                continue;
+            }
+            int first = tree.size();
+            tree[parent].left = first;
+            tree[parent].right = first + 1;
+            tree.resize(first + 2);
+            leaves.resize(first + 2);
+            nodeCentroids.insert(nodeCentroids.end(), &allChildren[(size_t)z * 2 * d], &allChildren[(size_t)(z + 1) * 2 * d]);
+            vector<int> members = move(leaves[parent].members);
+            leaves[parent] = Leaf();
+            for (int m = 0; m < counts[z]; m++) {
+                int i = members[m];
+                int child = first + side[m];
+                long long w = weightOf(i);
+                leaves[child].members.push_back(i);
+                leaves[child].weight += w;
+                leaves[child].sse += (double)w * squaredDistance(elements + (size_t)i * d, &nodeCentroids[(size_t)child * d], d);
+            }
+            offer(first);
+            offer(first + 1);
+            leafCount++;
+        }
+    }
+
+    /**
+     * @brief Numbers the leaves in tree order and fills clusters and inertia at ROOT.
+     */
+    void numberLeaves() {
+        k = 0;
+        leafNodes.clear();
+        inertia = 0;
+        for (int node = 0; node < (int)tree.size(); node++) {
+            if (tree[node].left >= 0)
+                continue;
+            tree[node].leaf = k++;
+            leafNodes.push_back(node);
+        }
+        clusters.assign(k, Cluster());
+        for (int j = 0; j < k; j++) {
+            Leaf& leaf = leaves[leafNodes[j]];
+            clusters[j].centroid.assign(&nodeCentroids[(size_t)leafNodes[j] * d], &nodeCentroids[(size_t)(leafNodes[j] + 1) * d]);
+            clusters[j].elements = move(leaf.members);
+            clusters[j].weight = leaf.weight;
+            inertia += leaf.sse;
+        }
+        leaves.clear();
+        KLOG_INFO(k << " leaves in " << profiler.getGenerations() << " rounds, inertia " << inertia);
+    }
+
+    /**
+     * @brief Sends the finished tree, its centroids and the inertia from ROOT to every rank.
+     */
+    void distributeTree() {
+        int shape[2] = {k, (int)tree.size()};
+        comm->broadcast(shape, 2, sizeof(int), ROOT);
+        k = shape[0];
+        tree.resize(shape[1]);
+        nodeCentroids.resize((size_t)shape[1] * d);
+        leafNodes.resize(k);
+        if (comm->rank() == ROOT)
+            profiler.addBytes(Phase::DISTRIBUTE_CENTROIDS, shape[1] * (sizeof(Node) + d));
+        comm->broadcast(tree.data(), shape[1], sizeof(Node), ROOT);
+        comm->broadcast(nodeCentroids.data(), shape[1], d, ROOT);
+        comm->broadcast(leafNodes.data(), k, sizeof(int), ROOT);
+        comm->broadcast(&inertia, 1, sizeof(double), ROOT);
+    }
+
+private:
+    Splitter splitter;
+};
@@ -0,0 +1,246 @@
+/**
+ * @file CentroidModel.h
+ * @brief Fitted centroids in a form ready for serving nearest-centroid queries
+ *
+ * The centroids are packed contiguously (k x d) next to their precomputed squared
+ * norms, so assignment needs only one dot product per point-centroid pair. Large
+ * batches are split across the threads of a WorkerPool, which are started once
+ * and then reused by every batch.
+ */
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "DistanceKernels.h"
+using namespace std;
+
+/**
+ * @struct PredictStats
+ * @brief Latency and throughput of the batches predicted so far.
+ */
+struct PredictStats {
+    long long batches = 0;   ///< Number of batches
+    long long points = 0;    ///< Number of points labelled
+    double p50 = 0;          ///< Median latency of the recent batches, seconds
+    double p95 = 0;          ///< 95th percentile latency of the recent batches, seconds
+    double p99 = 0;          ///< 99th percentile latency of the recent batches, seconds
+    double max = 0;          ///< Slowest batch, seconds
+    double pointsPerSecond = 0;
+};
+
+/**
+ * @class WorkerPool
+ * @brief Threads kept between batches, so a batch costs a wakeup per worker
+ *        rather than a thread creation and join.
+ */
+class WorkerPool {
+public:
+    WorkerPool() = default;
+
+    ~WorkerPool() {
+        {
+            lock_guard<mutex> guard(lock);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (thread& worker : workers)
+            worker.join();
+    }
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    /**
+     * Call work(w) for every w in [0, count), w = 0 on the calling thread, and
+     * wait for all of them. Threads are started the first time they are needed.
+     * @param count number of calls, the caller's included
+     * @param work called concurrently, once per index
+     */
+    void run(int count, const function<void(int)>& work) {
+        unique_lock<mutex> guard(lock);
+        while ((int)workers.size() < count - 1) {
+            int id = workers.size() + 1;
+            workers.emplace_back([this, id, seen = batch] { serve(id, seen); });
+        }
+        job = &work;
+        active = count;
+        pending = count - 1;
+        batch++;
+        guard.unlock();
+        wake.notify_all();
+        work(0);
+        guard.lock();
+        done.wait(guard, [&] { return pending == 0; });
+        job = nullptr;
+    }
+
+private:
+    mutex lock;
+    condition_variable wake;             ///< Signals a new batch or stopping
+    condition_variable done;             ///< Signals the last worker of a batch finishing
+    vector<thread> workers;              ///< Indices 1 and up; index 0 is the caller
+    const function<void(int)>* job = nullptr;
+    int active = 0;                      ///< Calls in the current batch
+    int pending = 0;                     ///< Worker calls of the current batch not yet finished
+    long long batch = 0;                 ///< Batches started so far
+    bool stopping = false;
+
+    void serve(int id, long long seen) {
+        unique_lock<mutex> guard(lock);
+        for (;;) {
+            wake.wait(guard, [&] { return stopping || batch != seen; });
+            if (stopping)
+                return;
+            seen = batch;
+            if (id >= active)
+                continue;
+            const function<void(int)>& work = *job;
+            guard.unlock();
+            work(id);
+            guard.lock();
+            if (--pending == 0)
+                done.notify_one();
+        }
+    }
+};
+
+/**
+ * @class CentroidModel
+ * @brief Packed centroids with norms plus the kernel that searches them.
+ */
+class CentroidModel {
+public:
+    /// Each thread gets at least this many points; smaller batches stay on the caller's thread
+    static const int MIN_POINTS_PER_THREAD = 256;
+
+    CentroidModel() = default;
+
+    /**
+     * @param centroids k row-major centroids of d values each
+     * @param k number of centroids
+     * @param d dimensionality
+     */
+    CentroidModel(const unsigned char* centroids, int k, int d)
+        : k(k), d(d), centroids(centroids, centroids + (size_t)k * d), norms(k),
+          kernel(selectNearestKernel(d)) {
+        for (int j = 0; j < k; j++)
+            norms[j] = dotProduct(centroids + (size_t)j * d, centroids + (size_t)j * d, d);
+    }
+
+    /**
+     * @return true once built from centroids
+     */
+    bool ready() const {
+        return kernel != nullptr;
+    }
+
+    int getK() const {
+        return k;
+    }
+
+    int getDimension() const {
+        return d;
+    }
+
+    /**
+     * @return the packed centroids, k x d
+     */
+    const unsigned char* getCentroids() const {
+        return centroids.data();
+    }
+
+    /**
+     * Label each point with its nearest centroid.
+     * @param points n row-major points of d values each
+     * @param n number of points
+     * @param labels output, n labels
+     * @param threads upper bound on worker threads
+     * @param pool threads that run the pieces of a large batch
+     */
+    void assign(const unsigned char* points, int n, int* labels, int threads, WorkerPool& pool) const {
+        int workers = max(1, min(threads, n / MIN_POINTS_PER_THREAD));
+        if (workers == 1) {
+            kernel(points, n, centroids.data(), norms.data(), k, d, labels);
+            return;
+        }
+        int each = n / workers;
+        pool.run(workers, [&](int w) {
+            int start = w * each, count = w == workers - 1 ? n - start : each;
+            kernel(points + (size_t)start * d, count, centroids.data(), norms.data(), k, d, labels + start);
+        });
+    }
+
+private:
+    int k = 0;
+    int d = 0;
+    vector<unsigned char> centroids;
+    vector<long long> norms;
+    NearestKernel kernel = nullptr;
+};
+
+/**
+ * @class LatencyRecorder
+ * @brief Collects batch latencies and summarizes them as PredictStats.
+ *
+ * Only the latest WINDOW latencies are kept, in a ring, so a long-lived serving
+ * loop uses fixed memory and a summary sorts at most WINDOW values. Counts,
+ * throughput and the maximum cover every batch since the last clear.
+ */
+class LatencyRecorder {
+public:
+    /// Number of recent batches the percentiles are taken over
+    static const int WINDOW = 4096;
+
+    /**
+     * @param seconds latency of one batch
+     * @param points size of that batch
+     */
+    void record(double seconds, int points) {
+        if (latencies.size() < WINDOW)
+            latencies.push_back(seconds);
+        else
+            latencies[batches % WINDOW] = seconds;
+        batches++;
+        total += seconds;
+        slowest = max(slowest, seconds);
+        this->points += points;
+    }
+
+    void clear() {
+        latencies.clear();
+        batches = 0;
+        total = 0;
+        slowest = 0;
+        points = 0;
+    }
+
+    PredictStats summarize() const {
+        PredictStats stats;
+        stats.batches = batches;
+        stats.points = points;
+        if (latencies.empty())
+            return stats;
+        vector<double> sorted = latencies;
+        sort(sorted.begin(), sorted.end());
+        auto percentile = [&](double p) {
+            return sorted[min(sorted.size() - 1, (size_t)(p * sorted.size()))];
+        };
+        stats.p50 = percentile(0.50);
+        stats.p95 = percentile(0.95);
+        stats.p99 = percentile(0.99);
+        stats.max = slowest;
+        stats.pointsPerSecond = total > 0 ? points / total : 0;
+        return stats;
+    }
+
+private:
+    vector<double> latencies;   ///< The latest WINDOW latencies, oldest overwritten first
+    long long batches = 0;
+    double total = 0;
+    double slowest = 0;
+    long long points = 0;
+};
@@ -0,0 +1,167 @@
+/**
+ * @file CentroidTree.h
+ * @brief kd-tree over the k centroids for exact nearest-centroid search in low d
+ *
+ * Brute-force assignment costs O(k) distances per point. For small d (colors)
+ * and large k (palettes of hundreds or thousands of colors) a kd-tree over the
+ * centroids, rebuilt every generation for O(k log k), answers each query in
+ * about O(log k): descend to the leaf holding the query, then visit the other
+ * side of a split only when the splitting plane is no farther than the best
+ * centroid found so far.
+ *
+ * Results match the brute-force kernels exactly, including ties: distances are
+ * exact integers, a subtree is only skipped when it is strictly farther, and equal
+ * distances resolve to the lowest centroid index.
+ */
+#pragma once
+#include <algorithm>
+#include <climits>
+#include <numeric>
+#include <vector>
+#include "DistanceKernels.h"
+using namespace std;
+
+/**
+ * @class CentroidTree
+ * @brief Static kd-tree over one generation's centroids.
+ */
+class CentroidTree {
+public:
+    /// Above this dimensionality the tree prunes too little to beat brute force
+    static const int MAX_DIMENSION = 8;
+    /// Centroids per leaf, scanned linearly
+    static const int LEAF_SIZE = 8;
+
+    /**
+     * Build the tree.
+     * @param centroids k row-major centroids of d values each
+     * @param k number of centroids
+     * @param d dimensionality
+     */
+    void build(const unsigned char* centroids, int k, int d) {
+        this->d = d;
+        ids.resize(k);
+        iota(ids.begin(), ids.end(), 0);
+        nodes.clear();
+        nodes.reserve(2 * (k / LEAF_SIZE + 1));
+        buildNode(centroids, 0, k);
+
+        // Store centroids in leaf order so each leaf scan is contiguous
+        points.resize((size_t)k * d);
+        positions.resize(k);
+        for (int i = 0; i < k; i++) {
+            positions[ids[i]] = i;
+            copy(centroids + (size_t)ids[i] * d, centroids + (size_t)(ids[i] + 1) * d, points.begin() + (size_t)i * d);
+        }
+    }
+
+    /**
+     * Label points with their nearest centroid.
+     * @param points n row-major points of d values each
+     * @param n number of points
+     * @param labels in: a previous label per point to seed the search, or -1;
+     *               out: index of the nearest centroid, ties to the lowest index
+     */
+    void assign(const unsigned char* points, int n, int* labels) const {
+        for (int i = 0; i < n; i++)
+            labels[i] = nearest(points + (size_t)i * d, labels[i]);
+    }
+
+    /**
+     * @param point d values
+     * @param hint a centroid index likely to be close (e.g. last generation's), or -1
+     * @return index of the nearest centroid, ties to the lowest index
+     */
+    int nearest(const unsigned char* point, int hint = -1) const {
+        Best best;
+        if (hint >= 0 && hint < (int)ids.size()) {
+            // Starting from a close candidate prunes most of the tree at once
+            best.id = hint;
+            best.distance = squaredDistance(point, &points[(size_t)positions[hint] * d], d);
+        }
+        search(0, point, best);
+        return best.id;
+    }
+
+private:
+    /**
+     * @struct Node
+     * @brief Inner nodes split on dimension split at value; leaves hold ids[begin, end).
+     */
+    struct Node {
+        int split = -1;     ///< Splitting dimension, or -1 for a leaf
+        int value = 0;      ///< Left subtree <= value <= right subtree along split
+        int begin = 0;      ///< First centroid (in leaf order) under this node
+        int end = 0;        ///< One past the last centroid under this node
+        int left = -1;
+        int right = -1;
+    };
+
+    struct Best {
+        int id = -1;
+        unsigned int distance = UINT_MAX;
+    };
+
+    int d = 0;
+    vector<Node> nodes;
+    vector<int> ids;                ///< Centroid index of each position in leaf order
+    vector<int> positions;          ///< Leaf-order position of each centroid index
+    vector<unsigned char> points;   ///< Centroids in leaf order
+
+    int buildNode(const unsigned char* centroids, int begin, int end) {
+        int index = nodes.size();
+        nodes.emplace_back();
+        nodes[index].begin = begin;
+        nodes[index].end = end;
+        if (end - begin <= LEAF_SIZE)
+            return index;
+
+        // Split the widest dimension at the median
+        int split = 0, widest = -1;
+        for (int t = 0; t < d; t++) {
+            int lo = 255, hi = 0;
+            for (int i = begin; i < end; i++) {
+                int v = centroids[(size_t)ids[i] * d + t];
+                lo = min(lo, v);
+                hi = max(hi, v);
+            }
+            if (hi - lo > widest) {
+                widest = hi - lo;
+                split = t;
+            }
+        }
+        if (widest == 0)
+            return index;  // all centroids identical: keep them in one leaf
+        int middle = (begin + end) / 2;
+        nth_element(ids.begin() + begin, ids.begin() + middle, ids.begin() + end, [&](int a, int b) {
+            return centroids[(size_t)a * d + split] < centroids[(size_t)b * d + split];
+        });
+        nodes[index].split = split;
+        nodes[index].value = centroids[(size_t)ids[middle] * d + split];
+        int left = buildNode(centroids, begin, middle);
+        int right = buildNode(centroids, middle, end);
+        nodes[index].left = left;
+        nodes[index].right = right;
+        return index;
+    }
+
+    void search(int index, const unsigned char* point, Best& best) const {
+        const Node& node = nodes[index];
+        if (node.split < 0) {
+            for (int i = node.begin; i < node.end; i++) {
+                unsigned int distance = squaredDistance(point, &points[(size_t)i * d], d);
+                if (distance < best.distance || (distance == best.distance && ids[i] < best.id)) {
+                    best.distance = distance;
+                    best.id = ids[i];
+                }
+            }
+            return;
+        }
+        int diff = (int)point[node.split] - node.value;
+        int near = diff < 0 ? node.left : node.right, far = diff < 0 ? node.right : node.left;
+        search(near, point, best);
+        // Equal distance still has to be searched, for the lowest-index tie
+        if ((unsigned int)(diff * diff) <= best.distance)
+            search(far, point, best);
+    }
+};
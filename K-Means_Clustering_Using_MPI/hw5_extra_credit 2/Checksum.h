@@ -0,0 +1,33 @@
+/**
+ * @file Checksum.h - CRC-32 shared by the PNG writer and the model file
+ */
+
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+using namespace std;
+
+/**
+ * CRC-32 (IEEE 802.3, as used by PNG and zlib).
+ * @param data bytes to checksum
+ * @param n number of bytes
+ * @param crc checksum of the preceding bytes, to continue a running checksum
+ * @return checksum of everything so far
+ */
+inline uint32_t crc32(const unsigned char* data, size_t n, uint32_t crc = 0) {
+    static const array<uint32_t, 256> table = [] {
+        array<uint32_t, 256> t;
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int b = 0; b < 8; b++)
+                c = c & 1 ? 0xedb88320 ^ (c >> 1) : c >> 1;
+            t[i] = c;
+        }
+        return t;
+    }();
+    crc = ~crc;
+    for (size_t i = 0; i < n; i++)
+        crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
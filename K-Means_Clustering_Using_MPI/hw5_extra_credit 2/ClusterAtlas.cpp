@@ -0,0 +1,97 @@
+/**
+ * @file ClusterAtlas.cpp - image-based visualization of MNIST clusters
+ */
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <thread>
+#include <vector>
+#include "ClusterAtlas.h"
+using namespace std;
+
+ClusterAtlas::Report ClusterAtlas::write(
+    const MNISTKMeansMPI::Clusters& clusters,
+    const MNISTPixel* images,
+    const string& prefix,
+    ImageWriter::Format format,
+    int columns
+) {
+    auto start = chrono::steady_clock::now();
+    int n = clusters.size();
+
+    // Workers claim clusters one at a time; big clusters don't hold up the rest
+    atomic<int> next(0);
+    int workers = max(1, min(n, (int)thread::hardware_concurrency()));
+    vector<thread> pool;
+    for (int w = 0; w < workers; w++)
+        pool.emplace_back([&] {
+            for (int i = next++; i < n; i = next++)
+                writeSheet(clusters[i], images, sheetName(prefix, i, format), format, columns);
+        });
+    for (thread& t : pool)
+        t.join();
+
+    // The index just references the sheets
+    string indexName = prefix + ".html";
+    ofstream f(indexName);
+    f << "<html><body style=\"background:#" << generateRandomHexColor() << ";\">\n";
+    for (int i = 0; i < n; i++) {
+        string sheet = filesystem::path(sheetName(prefix, i, format)).filename().string();
+        f << "<h3>Cluster #" << i + 1 << " (" << clusters[i].elements.size() << " images)</h3>\n";
+        f << "<img src=\"" << sheet << "\" style=\"image-rendering:pixelated;zoom:2;\">\n";
+    }
+    f << "</body></html>\n";
+    f.close();
+
+    Report report;
+    for (int i = 0; i <= n; i++) {
+        string name = i < n ? sheetName(prefix, i, format) : indexName;
+        error_code ec;
+        uintmax_t size = filesystem::file_size(name, ec);
+        if (!ec) {
+            report.files++;
+            report.bytes += size;
+        }
+    }
+    report.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    return report;
+}
+
+void ClusterAtlas::writeSheet(
+    const MNISTKMeansMPI::Cluster& cluster,
+    const MNISTPixel* images,
+    const string& filename,
+    ImageWriter::Format format,
+    int columns
+) {
+    const int rowsN = MNISTPixel::getNumRows(), colsN = MNISTPixel::getNumCols();
+    int tiles = cluster.elements.size() + 1;
+    int across = min(columns, tiles), down = (tiles + columns - 1) / columns;
+    int width = across * (colsN + GAP) + GAP, height = down * (rowsN + GAP) + GAP;
+    vector<unsigned char> sheet((size_t)width * height, BACKGROUND);
+
+    for (int t = 0; t < tiles; t++) {
+        const unsigned char* pixels = t == 0
+            ? cluster.centroid.data()
+            : images[cluster.elements[t - 1]].getPixels().data();
+        int x0 = GAP + (t % columns) * (colsN + GAP), y0 = GAP + (t / columns) * (rowsN + GAP);
+        for (int row = 0; row < rowsN; row++)
+            copy(pixels + row * colsN, pixels + (row + 1) * colsN, &sheet[(size_t)(y0 + row) * width + x0]);
+    }
+    ImageWriter::write(filename, sheet.data(), width, height, format);
+}
+
+string ClusterAtlas::sheetName(const string& prefix, int i, ImageWriter::Format format) {
+    return prefix + "_cluster" + to_string(i + 1) + "." + ImageWriter::extension(format);
+}
+
+string ClusterAtlas::generateRandomHexColor() {
+    mt19937 rng(random_device{}());
+    uniform_int_distribution<> distrib(0, 255);
+    char buffer[7];
+    snprintf(buffer, sizeof(buffer), "%02x%02x%02x", distrib(rng), distrib(rng), distrib(rng));
+    return string(buffer);
+}
@@ -0,0 +1,75 @@
+/**
+ * @file ClusterAtlas.h - image-based visualization of MNIST clusters
+ *
+ * Each cluster becomes one contact sheet (sprite atlas): the centroid in the first
+ * tile followed by every member image. Sheets are rendered and encoded in parallel,
+ * one cluster per task, and a small HTML index references them.
+ */
+
+#pragma once
+#include <cstdint>
+#include <string>
+#include "ImageWriter.h"
+#include "MNISTKMeansMPI.h"
+#include "MNISTPixel.h"
+using namespace std;
+
+/**
+ * @class ClusterAtlas
+ * @brief Writes per-cluster contact sheets plus an HTML index.
+ */
+class ClusterAtlas {
+public:
+    /**
+     * @struct Report
+     * @brief What a call to write produced.
+     */
+    struct Report {
+        int files = 0;          ///< Files written, including the index
+        uintmax_t bytes = 0;    ///< Total size of those files
+        double seconds = 0;     ///< Wall time to render and write them
+    };
+
+    /**
+     * Render the clusters.
+     * @param clusters The final clusters after convergence.
+     * @param images Pointer to the MNIST image data.
+     * @param prefix Path prefix; writes <prefix>_cluster<i>.<ext> and <prefix>.html
+     * @param format Image format of the sheets
+     * @param columns Number of tiles per sheet row
+     * @return files written, their total size and the time taken
+     */
+    static Report write(
+        const MNISTKMeansMPI::Clusters& clusters,
+        const MNISTPixel* images,
+        const string& prefix,
+        ImageWriter::Format format = ImageWriter::PNG,
+        int columns = 32
+    );
+
+private:
+    static const int GAP = 2;               ///< Pixels between tiles
+    static const unsigned char BACKGROUND = 64;
+
+    /**
+     * Compose and write the sheet for one cluster.
+     */
+    static void writeSheet(
+        const MNISTKMeansMPI::Cluster& cluster,
+        const MNISTPixel* images,
+        const string& filename,
+        ImageWriter::Format format,
+        int columns
+    );
+
+    /**
+     * @return "<prefix>_cluster<i>.<ext>"
+     */
+    static string sheetName(const string& prefix, int i, ImageWriter::Format format);
+
+    /**
+     * Generates a random hex color for the HTML background.
+     * @return A string representing a random hex color code.
+     */
+    static string generateRandomHexColor();
+};
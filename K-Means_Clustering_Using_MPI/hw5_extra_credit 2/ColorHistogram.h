@@ -0,0 +1,172 @@
+/**
+ * @file ColorHistogram.h
+ * @brief Parallel histogram of the distinct colors in an image
+ *
+ * Colors of up to three 8-bit channels pack into a 24-bit key, so the histogram is
+ * a direct-indexed table of 2^(8 * channels) counters. Threads count disjoint slices
+ * of the pixels with relaxed atomic increments, then compact disjoint slices of the
+ * table into (color, count) pairs in key order. The table is kept afterwards and
+ * maps every color to its position among the distinct colors, which turns labels of
+ * distinct colors back into per-pixel labels in one lookup.
+ *
+ * Noisy photos can have nearly as many distinct colors as pixels. Keeping only the
+ * top bits of each channel bounds the histogram at 2^(bits * channels) buckets; each
+ * bucket then also sums its pixels, so it is represented by their mean color and
+ * weighted k-means over the buckets still sees the true center of mass.
+ */
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+using namespace std;
+
+/**
+ * @class ColorHistogram
+ * @brief Distinct colors of an image with their pixel counts.
+ */
+class ColorHistogram {
+public:
+    /// Keys must fit in 24 bits
+    static const int MAX_CHANNELS = 3;
+    /// Histograms up to this many keys are counted in private per-thread tables
+    static const size_t PRIVATE_KEYS = 1 << 18;
+
+    /**
+     * Count the distinct colors of an image.
+     * @param pixels n pixels of channels interleaved bytes each
+     * @param n number of pixels
+     * @param channels bytes per pixel, 1 to MAX_CHANNELS
+     * @param threads number of threads to use
+     * @param bits significant bits kept per channel, 1 to 8; below 8 colors sharing
+     *             their top bits are merged into one entry with their mean color
+     */
+    void build(const unsigned char* pixels, size_t n, int channels, int threads, int bits = 8) {
+        this->channels = channels;
+        this->bits = bits;
+        size_t keys = (size_t)1 << (bits * channels);
+        threads = max(1, threads);
+        table.reset(new uint32_t[keys]());
+        vector<uint64_t> sums(bits < 8 ? keys * channels : 0);
+
+        // Count, each thread over its own slice of the pixels. Small tables are
+        // private per thread and merged; the full 24-bit table is shared and atomic.
+        mutex merge;
+        parallel(threads, n, [&](int, size_t from, size_t to) {
+            if (keys > PRIVATE_KEYS) {
+                for (size_t i = from; i < to; i++) {
+                    const unsigned char* pixel = pixels + i * channels;
+                    uint32_t c = key(pixel);
+                    atomic_ref<uint32_t>(table[c]).fetch_add(1, memory_order_relaxed);
+                    for (size_t b = 0; b < sums.size() / keys; b++)
+                        atomic_ref<uint64_t>(sums[c * channels + b]).fetch_add(pixel[b], memory_order_relaxed);
+                }
+                return;
+            }
+            vector<uint32_t> myCounts(keys, 0);
+            vector<uint64_t> mySums(sums.size(), 0);
+            for (size_t i = from; i < to; i++) {
+                const unsigned char* pixel = pixels + i * channels;
+                uint32_t c = key(pixel);
+                myCounts[c]++;
+                if (bits < 8)
+                    for (int b = 0; b < channels; b++)
+                        mySums[(size_t)c * channels + b] += pixel[b];
+            }
+            lock_guard<mutex> lock(merge);
+            for (size_t c = 0; c < keys; c++)
+                table[c] += myCounts[c];
+            for (size_t x = 0; x < sums.size(); x++)
+                sums[x] += mySums[x];
+        });
+
+        // Compact in key order: count the distinct keys per slice, then each slice
+        // writes its colors at the offset given by the slices before it
+        vector<size_t> found(threads + 1, 0);
+        parallel(threads, keys, [&](int t, size_t from, size_t to) {
+            size_t distinct = 0;
+            for (size_t c = from; c < to; c++)
+                distinct += table[c] != 0;
+            found[t + 1] = distinct;
+        });
+        for (int t = 0; t < threads; t++)
+            found[t + 1] += found[t];
+        colors.resize(found[threads] * channels);
+        counts.resize(found[threads]);
+        parallel(threads, keys, [&](int t, size_t from, size_t to) {
+            size_t next = found[t];
+            for (size_t c = from; c < to; c++)
+                if (table[c] != 0) {
+                    uint32_t count = table[c];
+                    for (int b = 0; b < channels; b++)
+                        colors[next * channels + b] = bits < 8
+                            ? (sums[c * channels + b] + count / 2) / count
+                            : (c >> (8 * (channels - 1 - b))) & 0xff;
+                    counts[next] = count;
+                    table[c] = next++;  // the table now maps color -> distinct index
+                }
+        });
+    }
+
+    /**
+     * @return number of distinct colors (or occupied buckets)
+     */
+    int size() const {
+        return counts.size();
+    }
+
+    /**
+     * @return the distinct colors in key order, size() x channels bytes
+     */
+    const unsigned char* getColors() const {
+        return colors.data();
+    }
+
+    /**
+     * @return pixel count of each distinct color
+     */
+    const int* getCounts() const {
+        return counts.data();
+    }
+
+    /**
+     * @param pixel a pixel of the image the histogram was built from
+     * @return position of its color (or bucket) among the distinct colors
+     */
+    int indexOf(const unsigned char* pixel) const {
+        return table[key(pixel)];
+    }
+
+    /**
+     * Run work over [0, n) split into contiguous slices, one per thread.
+     * @param threads number of slices
+     * @param n size of the range
+     * @param work called as work(t, from, to) for each slice t
+     */
+    template <typename Work>
+    static void parallel(int threads, size_t n, Work work) {
+        vector<thread> pool;
+        for (int t = 1; t < threads; t++)
+            pool.emplace_back([&, t] { work(t, n * t / threads, n * (t + 1) / threads); });
+        work(0, 0, n / threads);
+        for (thread& worker : pool)
+            worker.join();
+    }
+
+private:
+    int channels = 0;
+    int bits = 8;
+    unique_ptr<uint32_t[]> table;   ///< Count per key while building, then distinct index
+    vector<unsigned char> colors;
+    vector<int> counts;
+
+    uint32_t key(const unsigned char* pixel) const {
+        uint32_t value = 0;
+        for (int b = 0; b < channels; b++)
+            value = value << bits | pixel[b] >> (8 - bits);
+        return value;
+    }
+};
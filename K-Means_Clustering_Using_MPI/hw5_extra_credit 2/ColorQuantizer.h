@@ -0,0 +1,119 @@
+/**
+ * @file ColorQuantizer.h - A subclass of KMeansMPI for palette quantization
+ *
+ * A photo has millions of pixels but usually far fewer distinct colors. Rather
+ * than clustering every pixel, ROOT builds a ColorHistogram of the distinct colors
+ * and the ranks run weighted k-means over (color, pixel count) pairs, which gives
+ * the same centroids as clustering the pixels themselves. The palette is then
+ * applied to every pixel through the histogram's color -> distinct index table.
+ *
+ * By default the histogram keeps HISTOGRAM_BITS bits per channel, which bounds the
+ * points to cluster at 2^(HISTOGRAM_BITS * channels) however noisy the image is;
+ * setHistogramBits(8) clusters the exact distinct colors.
+ *
+ * Quantizing a 50-megapixel image to 256 colors does not yet take under a
+ * second on one core: quantize_benchmark spends about 1.3 s there, nearly all of
+ * it in building the histogram and mapping the pixels, each a pass over the
+ * whole image. The fit itself takes tens of milliseconds. Those two passes are
+ * the ones split over setThreads, so the target relies on several cores, which
+ * has not been measured.
+ */
+
+#pragma once
+#include <chrono>
+#include "ColorHistogram.h"
+#include "KMeansMPI.h"
+using namespace std;
+
+/**
+ * @class ColorQuantizer
+ * @brief Reduces an image to a palette of k colors.
+ */
+class ColorQuantizer : public KMeansMPI {
+public:
+    /**
+     * @struct Report
+     * @brief Sizes and timings of one quantize call.
+     */
+    struct Report {
+        int distinctColors = 0;      ///< Histogram entries actually clustered
+        int generations = 0;         ///< k-means generations run
+        double histogramSeconds = 0; ///< Building the histogram
+        double fitSeconds = 0;       ///< Weighted k-means over the distinct colors
+        double mapSeconds = 0;       ///< Writing the quantized pixels
+    };
+
+    /// Default bits kept per channel when building the histogram
+    static const int HISTOGRAM_BITS = 5;
+
+    /**
+     * @param k the number of palette colors
+     */
+    explicit ColorQuantizer(int k) : KMeansMPI(k) {}
+
+    /**
+     * @param threads Threads used at ROOT for the histogram and the final mapping
+     */
+    void setThreads(int threads) {
+        this->threads = max(1, threads);
+    }
+
+    /**
+     * @param bits Bits kept per channel in the histogram, 1 to 8 (8 is exact)
+     */
+    void setHistogramBits(int bits) {
+        histogramBits = min(8, max(1, bits));
+    }
+
+    using KMeansMPI::fit;
+    /**
+     * Quantize an image at ROOT; every other rank calls fitWork meanwhile.
+     * @param pixels n pixels of channels interleaved bytes each
+     * @param n number of pixels, less than 2^31 so pixel counts fit the weights
+     * @param channels bytes per pixel, 1 to ColorHistogram::MAX_CHANNELS
+     * @param out n x channels quantized pixels; may be the same buffer as pixels
+     * @return sizes and timings of the stages
+     */
+    Report quantize(const unsigned char* pixels, size_t n, int channels, unsigned char* out) {
+        Report report;
+        auto start = chrono::steady_clock::now();
+        histogram.build(pixels, n, channels, threads, histogramBits);
+        auto built = chrono::steady_clock::now();
+
+        fit(histogram.getColors(), histogram.size(), channels, histogram.getCounts());
+        auto fitted = chrono::steady_clock::now();
+
+        // Palette index of each distinct color, then of each pixel
+        vector<int> label(histogram.size());
+        for (int c = 0; c < k; c++)
+            for (int index : clusters[c].elements)
+                label[index] = c;
+        const unsigned char* palette = getPalette();
+        ColorHistogram::parallel(threads, n, [&](int, size_t from, size_t to) {
+            for (size_t i = from; i < to; i++) {
+                const unsigned char* color = palette + (size_t)label[histogram.indexOf(pixels + i * channels)] * channels;
+                copy(color, color + channels, out + i * channels);
+            }
+        });
+        auto mapped = chrono::steady_clock::now();
+
+        report.distinctColors = histogram.size();
+        report.generations = profiler.getGenerations();
+        report.histogramSeconds = chrono::duration<double>(built - start).count();
+        report.fitSeconds = chrono::duration<double>(fitted - built).count();
+        report.mapSeconds = chrono::duration<double>(mapped - fitted).count();
+        return report;
+    }
+
+    /**
+     * @return the k palette colors of the last fit, k x channels bytes
+     */
+    const unsigned char* getPalette() const {
+        return model.getCentroids();
+    }
+
+private:
+    ColorHistogram histogram;
+    int threads = max(1, (int)thread::hardware_concurrency());
+    int histogramBits = HISTOGRAM_BITS;
+};
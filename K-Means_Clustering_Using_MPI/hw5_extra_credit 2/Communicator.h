@@ -0,0 +1,342 @@
+/**
+ * @file Communicator.h
+ * @brief Collective communication interface used by KMeansMPI, with an MPI backend
+ *
+ * KMeansMPI only needs a handful of collectives. Hiding them behind this interface
+ * lets the same fitWork run on MPI processes (MPICommunicator) or on threads of a
+ * single process (SharedMemoryCommunicator). Counts and displacements are given in
+ * elements of elemSize bytes, like MPI counts for a contiguous datatype.
+ *
+ * broadcastBlocks and gathervIndexed move data that is not contiguous in the
+ * caller's memory (one vector per cluster, selected rows of a table) without
+ * packing it into a staging buffer first; the MPI backend describes the layout
+ * with a derived datatype instead.
+ *
+ * The window calls are one-sided: after the collective openWindow, any rank can
+ * add into or read another rank's window without that rank taking part, until
+ * the collective closeWindow. Only one window is open at a time.
+ *
+ * writeFile lets every rank put its own piece of one output file, so no rank
+ * has to gather the whole of it.
+ */
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <string>
+#include <vector>
+#include <mpi.h>
+using namespace std;
+
+/**
+ * @class Communicator
+ * @brief A group of ranks that can run collectives together.
+ */
+class Communicator {
+public:
+    /// Reductions supported by allreduce
+    enum ReduceOp { SUM, MAX, MIN };
+
+    virtual ~Communicator() = default;
+
+    /**
+     * @return rank of the caller within the group
+     */
+    virtual int rank() const = 0;
+
+    /**
+     * @return number of ranks in the group
+     */
+    virtual int size() const = 0;
+
+    /**
+     * Copy count elements from root's data into every other rank's data.
+     */
+    virtual void broadcast(void* data, int count, int elemSize, int root) = 0;
+
+    /**
+     * Root's send holds counts[z] elements for rank z at displs[z]; each rank receives
+     * its recvCount elements into recv. counts and displs are only read at root.
+     */
+    virtual void scatterv(const void* send, const int* counts, const int* displs,
+                          void* recv, int recvCount, int elemSize, int root) = 0;
+
+    /**
+     * Every rank sends count elements; root receives them in rank order into recv.
+     */
+    virtual void gather(const void* send, int count, void* recv, int elemSize, int root) = 0;
+
+    /**
+     * Every rank sends count elements; root places rank z's counts[z] elements at displs[z].
+     * counts and displs are only read at root.
+     */
+    virtual void gatherv(const void* send, int count, void* recv,
+                         const int* counts, const int* displs, int elemSize, int root) = 0;
+
+    /**
+     * Like broadcast, for data held in blockCount separate blocks of elemSize bytes:
+     * root's blocks[b] is copied into every other rank's blocks[b], in place.
+     */
+    virtual void broadcastBlocks(void* const* blocks, int blockCount, int elemSize, int root) = 0;
+
+    /**
+     * Like gatherv, but each rank sends the count elements of send at positions
+     * indices[0..count), in that order, without packing them first.
+     * counts and displs are only read at root.
+     */
+    virtual void gathervIndexed(const void* send, const int* indices, int count, void* recv,
+                                const int* counts, const int* displs, int elemSize, int root) = 0;
+
+    /**
+     * Every rank sends count elements and receives everyone's, in rank order.
+     */
+    virtual void allgather(const void* send, int count, void* recv, int elemSize) = 0;
+
+    /**
+     * Personalized all-to-all: sendCounts[z] elements at sendDispls[z] go to rank z, and
+     * recvCounts[z] elements from rank z land at recvDispls[z].
+     */
+    virtual void alltoallv(const void* send, const int* sendCounts, const int* sendDispls,
+                           void* recv, const int* recvCounts, const int* recvDispls, int elemSize) = 0;
+
+    /**
+     * Element-wise reduction of count doubles over all ranks; every rank gets the result.
+     * @pre send and recv do not overlap
+     */
+    virtual void allreduce(const double* send, double* recv, int count, ReduceOp op) = 0;
+
+    /**
+     * Wait until every rank has arrived.
+     */
+    virtual void barrier() = 0;
+
+    /**
+     * Collective. Exposes count zeroed long longs of this rank's memory for one-sided
+     * access (count may differ between ranks and be 0).
+     * @return the local window memory, valid until closeWindow
+     */
+    virtual long long* openWindow(int count) = 0;
+
+    /**
+     * Adds count values into target's window starting at offset. Each element is
+     * updated atomically; the addition completes at the next flush or fetch to target.
+     */
+    virtual void accumulate(const long long* data, int count, int target, int offset) = 0;
+
+    /**
+     * Reads count values of target's window starting at offset, each atomically, after
+     * completing this rank's outstanding accumulates to target.
+     */
+    virtual void fetch(long long* data, int count, int target, int offset) = 0;
+
+    /**
+     * Completes this rank's outstanding accumulates to target.
+     */
+    virtual void flush(int target) = 0;
+
+    /**
+     * Collective. Completes all accumulates and releases the window.
+     */
+    virtual void closeWindow() = 0;
+
+    /**
+     * Collective. Replaces path with a file of totalCount elements, each rank writing its
+     * count elements at element offset. The ranks' pieces should cover the file.
+     * @return true on every rank if the file was written by every rank
+     */
+    virtual bool writeFile(const string& path, const void* data, int count,
+                           long long offset, long long totalCount, int elemSize) = 0;
+
+    /**
+     * @return seconds on a monotonic clock, for timing phases
+     */
+    static double wallTime() {
+        return chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()).count();
+    }
+};
+
+/**
+ * @class MPICommunicator
+ * @brief Communicator over an MPI communicator (MPI_COMM_WORLD by default).
+ */
+class MPICommunicator : public Communicator {
+public:
+    explicit MPICommunicator(MPI_Comm comm = MPI_COMM_WORLD) : comm(comm) {}
+
+    ~MPICommunicator() override {
+        int finalized = 0;
+        MPI_Finalized(&finalized);
+        if (!finalized) {
+            for (auto& entry : types)
+                MPI_Type_free(&entry.second);
+            if (blockLayout != MPI_DATATYPE_NULL)
+                MPI_Type_free(&blockLayout);
+            if (gatherLayout != MPI_DATATYPE_NULL)
+                MPI_Type_free(&gatherLayout);
+            if (window != MPI_WIN_NULL)
+                closeWindow();
+        }
+    }
+
+    MPICommunicator(const MPICommunicator&) = delete;
+    MPICommunicator& operator=(const MPICommunicator&) = delete;
+
+    int rank() const override {
+        int r;
+        MPI_Comm_rank(comm, &r);
+        return r;
+    }
+
+    int size() const override {
+        int p;
+        MPI_Comm_size(comm, &p);
+        return p;
+    }
+
+    void broadcast(void* data, int count, int elemSize, int root) override {
+        MPI_Bcast(data, count, type(elemSize), root, comm);
+    }
+
+    void scatterv(const void* send, const int* counts, const int* displs,
+                  void* recv, int recvCount, int elemSize, int root) override {
+        MPI_Scatterv(send, counts, displs, type(elemSize), recv, recvCount, type(elemSize), root, comm);
+    }
+
+    void gather(const void* send, int count, void* recv, int elemSize, int root) override {
+        MPI_Gather(send, count, type(elemSize), recv, count, type(elemSize), root, comm);
+    }
+
+    void gatherv(const void* send, int count, void* recv,
+                 const int* counts, const int* displs, int elemSize, int root) override {
+        MPI_Gatherv(send, count, type(elemSize), recv, counts, displs, type(elemSize), root, comm);
+    }
+
+    void broadcastBlocks(void* const* blocks, int blockCount, int elemSize, int root) override {
+        // Absolute addresses relative to MPI_BOTTOM, one block each
+        addresses.resize(blockCount);
+        for (int b = 0; b < blockCount; b++)
+            MPI_Get_address(blocks[b], &addresses[b]);
+        // Blocks that stay put (centroids during a fit) reuse the committed layout
+        if (addresses != blockAddresses || elemSize != blockElemSize) {
+            if (blockLayout != MPI_DATATYPE_NULL)
+                MPI_Type_free(&blockLayout);
+            MPI_Type_create_hindexed_block(blockCount, 1, addresses.data(), type(elemSize), &blockLayout);
+            MPI_Type_commit(&blockLayout);
+            blockAddresses = addresses;
+            blockElemSize = elemSize;
+        }
+        MPI_Bcast(MPI_BOTTOM, 1, blockLayout, root, comm);
+    }
+
+    void gathervIndexed(const void* send, const int* indices, int count, void* recv,
+                        const int* counts, const int* displs, int elemSize, int root) override {
+        // The same rows gathered again (a fit's sample each generation) reuse the committed layout
+        if (gatherLayout == MPI_DATATYPE_NULL || elemSize != gatherElemSize
+                || !equal(indices, indices + count, gatherIndices.begin(), gatherIndices.end())) {
+            if (gatherLayout != MPI_DATATYPE_NULL)
+                MPI_Type_free(&gatherLayout);
+            MPI_Type_create_indexed_block(count, 1, indices, type(elemSize), &gatherLayout);
+            MPI_Type_commit(&gatherLayout);
+            gatherIndices.assign(indices, indices + count);
+            gatherElemSize = elemSize;
+        }
+        // An empty layout is sent as zero items: root posts no receive for a zero count
+        MPI_Gatherv(send, count > 0 ? 1 : 0, gatherLayout, recv, counts, displs, type(elemSize), root, comm);
+    }
+
+    void allgather(const void* send, int count, void* recv, int elemSize) override {
+        MPI_Allgather(send, count, type(elemSize), recv, count, type(elemSize), comm);
+    }
+
+    void alltoallv(const void* send, const int* sendCounts, const int* sendDispls,
+                   void* recv, const int* recvCounts, const int* recvDispls, int elemSize) override {
+        MPI_Alltoallv(send, sendCounts, sendDispls, type(elemSize),
+                      recv, recvCounts, recvDispls, type(elemSize), comm);
+    }
+
+    void allreduce(const double* send, double* recv, int count, ReduceOp op) override {
+        MPI_Op mpiOp = op == SUM ? MPI_SUM : op == MAX ? MPI_MAX : MPI_MIN;
+        MPI_Allreduce(send, recv, count, MPI_DOUBLE, mpiOp, comm);
+    }
+
+    void barrier() override {
+        MPI_Barrier(comm);
+    }
+
+    long long* openWindow(int count) override {
+        // Memory allocated by MPI lets ranks on one node share it directly (osc/sm)
+        long long* base;
+        MPI_Win_allocate((MPI_Aint)count * sizeof(long long), sizeof(long long), MPI_INFO_NULL, comm, &base, &window);
+        fill(base, base + count, 0);
+        MPI_Barrier(comm);  // zeroed everywhere before anyone accumulates
+        MPI_Win_lock_all(MPI_MODE_NOCHECK, window);
+        return base;
+    }
+
+    void accumulate(const long long* data, int count, int target, int offset) override {
+        MPI_Accumulate(data, count, MPI_LONG_LONG, target, offset, count, MPI_LONG_LONG, MPI_SUM, window);
+    }
+
+    void fetch(long long* data, int count, int target, int offset) override {
+        // A no-op accumulate rather than MPI_Get, so the read is atomic against MPI_Accumulate
+        MPI_Win_flush(target, window);
+        MPI_Get_accumulate(nullptr, 0, MPI_LONG_LONG, data, count, MPI_LONG_LONG,
+                           target, offset, count, MPI_LONG_LONG, MPI_NO_OP, window);
+        MPI_Win_flush(target, window);
+    }
+
+    void flush(int target) override {
+        MPI_Win_flush(target, window);
+    }
+
+    void closeWindow() override {
+        MPI_Win_unlock_all(window);
+        MPI_Win_free(&window);
+    }
+
+    bool writeFile(const string& path, const void* data, int count,
+                   long long offset, long long totalCount, int elemSize) override {
+        // Files default to MPI_ERRORS_RETURN, and open fails on every rank or none
+        MPI_File file;
+        int ok = MPI_File_open(comm, path.c_str(), MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &file)
+            == MPI_SUCCESS;
+        if (ok) {
+            ok = MPI_File_set_size(file, (MPI_Offset)totalCount * elemSize) == MPI_SUCCESS;
+            MPI_Status status;
+            ok = MPI_File_write_at_all(file, (MPI_Offset)offset * elemSize, data, count, type(elemSize), &status)
+                == MPI_SUCCESS && ok;
+            ok = MPI_File_close(&file) == MPI_SUCCESS && ok;
+        }
+        int all;
+        MPI_Allreduce(&ok, &all, 1, MPI_INT, MPI_MIN, comm);
+        return all;
+    }
+
+private:
+    MPI_Comm comm;
+    map<int, MPI_Datatype> types;                   ///< Committed contiguous types, by element size
+    vector<MPI_Aint> addresses;                     ///< Scratch for broadcastBlocks
+    vector<MPI_Aint> blockAddresses;                ///< Blocks described by blockLayout
+    int blockElemSize = 0;                          ///< Their size
+    MPI_Datatype blockLayout = MPI_DATATYPE_NULL;   ///< Last broadcastBlocks layout, committed
+    vector<int> gatherIndices;                      ///< Positions described by gatherLayout
+    int gatherElemSize = 0;                         ///< Their size
+    MPI_Datatype gatherLayout = MPI_DATATYPE_NULL;  ///< Last gathervIndexed layout, committed
+    MPI_Win window = MPI_WIN_NULL;                  ///< Open window, if any
+
+    /**
+     * @return a committed datatype of elemSize contiguous bytes
+     */
+    MPI_Datatype type(int elemSize) {
+        if (elemSize == 1)
+            return MPI_BYTE;
+        auto found = types.find(elemSize);
+        if (found != types.end())
+            return found->second;
+        MPI_Datatype t;
+        MPI_Type_contiguous(elemSize, MPI_BYTE, &t);
+        MPI_Type_commit(&t);
+        types[elemSize] = t;
+        return t;
+    }
+};
@@ -0,0 +1,194 @@
+/**
+ * @file DistanceKernels.h
+ * @brief Squared Euclidean distance kernels for k-means over unsigned char vectors
+ *
+ * The k-means engine takes its dimensionality from the data at runtime. The hot
+ * shapes (d = 3 for colors, d = 784 for MNIST) still get kernels instantiated with a
+ * compile-time trip count so the compiler can unroll and vectorize them; every other
+ * d uses a generic loop written so that it auto-vectorizes as well.
+ * selectDistanceKernel() picks the kernel once per fit.
+ *
+ * Nearest-centroid kernels use the expansion |x - c|^2 = |x|^2 - 2 x.c + |c|^2:
+ * with |c|^2 precomputed, the nearest centroid minimizes |c|^2 - 2 x.c, which
+ * costs one dot product per pair and is exact in integer arithmetic.
+ */
+#pragma once
+using namespace std;
+
+/**
+ * Block distance kernel: dist[i * k + j] = |points[i] - centroids[j]|^2
+ * @param points    n row-major points of d values each
+ * @param n         number of points
+ * @param centroids k row-major centroids of d values each
+ * @param k         number of centroids
+ * @param d         dimensionality (ignored by fixed-d kernels)
+ * @param dist      output, n x k squared distances
+ */
+using DistanceKernel = void (*)(const unsigned char* points, int n,
+                                const unsigned char* centroids, int k, int d,
+                                double* dist);
+
+/**
+ * Squared distance with the dimensionality known at compile time.
+ * Accumulates in 32 bits, which is exact for D < 66000.
+ * @tparam D dimensionality
+ */
+template <int D>
+inline unsigned int squaredDistanceFixed(const unsigned char* a, const unsigned char* b) {
+    unsigned int sum = 0;
+    for (int i = 0; i < D; i++) {
+        int diff = (int)a[i] - (int)b[i];
+        sum += (unsigned int)(diff * diff);
+    }
+    return sum;
+}
+
+/**
+ * Squared distance for any dimensionality (exact for d < 66000).
+ */
+inline unsigned int squaredDistance(const unsigned char* a, const unsigned char* b, int d) {
+    unsigned int sum = 0;
+    for (int i = 0; i < d; i++) {
+        int diff = (int)a[i] - (int)b[i];
+        sum += (unsigned int)(diff * diff);
+    }
+    return sum;
+}
+
+/**
+ * Block kernel specialized for dimensionality D.
+ */
+template <int D>
+void distanceBlockFixed(const unsigned char* points, int n,
+                        const unsigned char* centroids, int k, int,
+                        double* dist) {
+    for (int i = 0; i < n; i++) {
+        const unsigned char* point = points + (size_t)i * D;
+        for (int j = 0; j < k; j++)
+            dist[(size_t)i * k + j] = squaredDistanceFixed<D>(point, centroids + (size_t)j * D);
+    }
+}
+
+/**
+ * Generic block kernel, used when no specialization matches d.
+ */
+inline void distanceBlockGeneric(const unsigned char* points, int n,
+                                 const unsigned char* centroids, int k, int d,
+                                 double* dist) {
+    for (int i = 0; i < n; i++) {
+        const unsigned char* point = points + (size_t)i * d;
+        for (int j = 0; j < k; j++)
+            dist[(size_t)i * k + j] = squaredDistance(point, centroids + (size_t)j * d, d);
+    }
+}
+
+/**
+ * Pick the fastest available block kernel for the given dimensionality.
+ * @param d dimensionality of the data
+ * @return a fixed-d kernel for the common shapes, otherwise the generic kernel
+ */
+inline DistanceKernel selectDistanceKernel(int d) {
+    switch (d) {
+        case 3:
+            return distanceBlockFixed<3>;
+        case 784:
+            return distanceBlockFixed<784>;
+        default:
+            return distanceBlockGeneric;
+    }
+}
+
+/**
+ * Nearest-centroid kernel: labels[i] = argmin_j |points[i] - centroids[j]|^2, ties to the lowest j
+ * @param points    n row-major points of d values each
+ * @param n         number of points
+ * @param centroids k row-major centroids of d values each
+ * @param norms     |centroids[j]|^2 for each j
+ * @param k         number of centroids
+ * @param d         dimensionality (ignored by fixed-d kernels)
+ * @param labels    output, n labels
+ */
+using NearestKernel = void (*)(const unsigned char* points, int n,
+                               const unsigned char* centroids, const long long* norms, int k, int d,
+                               int* labels);
+
+/**
+ * Dot product with the dimensionality known at compile time (exact for D < 66000).
+ * @tparam D dimensionality
+ */
+template <int D>
+inline unsigned int dotProductFixed(const unsigned char* a, const unsigned char* b) {
+    unsigned int sum = 0;
+    for (int i = 0; i < D; i++)
+        sum += (unsigned int)a[i] * b[i];
+    return sum;
+}
+
+/**
+ * Dot product for any dimensionality (exact for d < 66000).
+ */
+inline unsigned int dotProduct(const unsigned char* a, const unsigned char* b, int d) {
+    unsigned int sum = 0;
+    for (int i = 0; i < d; i++)
+        sum += (unsigned int)a[i] * b[i];
+    return sum;
+}
+
+/**
+ * Nearest-centroid kernel specialized for dimensionality D.
+ */
+template <int D>
+void nearestFixed(const unsigned char* points, int n,
+                  const unsigned char* centroids, const long long* norms, int k, int,
+                  int* labels) {
+    for (int i = 0; i < n; i++) {
+        const unsigned char* point = points + (size_t)i * D;
+        int best = 0;
+        long long bestScore = norms[0] - 2LL * dotProductFixed<D>(point, centroids);
+        for (int j = 1; j < k; j++) {
+            long long score = norms[j] - 2LL * dotProductFixed<D>(point, centroids + (size_t)j * D);
+            if (score < bestScore) {
+                bestScore = score;
+                best = j;
+            }
+        }
+        labels[i] = best;
+    }
+}
+
+/**
+ * Generic nearest-centroid kernel, used when no specialization matches d.
+ */
+inline void nearestGeneric(const unsigned char* points, int n,
+                           const unsigned char* centroids, const long long* norms, int k, int d,
+                           int* labels) {
+    for (int i = 0; i < n; i++) {
+        const unsigned char* point = points + (size_t)i * d;
+        int best = 0;
+        long long bestScore = norms[0] - 2LL * dotProduct(point, centroids, d);
+        for (int j = 1; j < k; j++) {
+            long long score = norms[j] - 2LL * dotProduct(point, centroids + (size_t)j * d, d);
+            if (score < bestScore) {
+                bestScore = score;
+                best = j;
+            }
+        }
+        labels[i] = best;
+    }
+}
+
+/**
+ * Pick the fastest available nearest-centroid kernel for the given dimensionality.
+ * @param d dimensionality of the data
+ * @return a fixed-d kernel for the common shapes, otherwise the generic kernel
+ */
+inline NearestKernel selectNearestKernel(int d) {
+    switch (d) {
+        case 3:
+            return nearestFixed<3>;
+        case 784:
+            return nearestFixed<784>;
+        default:
+            return nearestGeneric;
+    }
+}
@@ -0,0 +1,222 @@
+/**
+ * @file ImageWriter.cpp - writers for 8-bit grayscale images
+ */
+#include <fstream>
+#include <cstdint>
+#include "Checksum.h"
+#include "ImageWriter.h"
+using namespace std;
+
+namespace {
+
+/**
+ * Appends bits least-significant first, as deflate requires.
+ */
+class BitWriter {
+public:
+    explicit BitWriter(vector<unsigned char>& out) : out(out) {}
+
+    void bits(uint32_t value, int count) {
+        buffer |= value << used;
+        used += count;
+        while (used >= 8) {
+            out.push_back(buffer & 0xff);
+            buffer >>= 8;
+            used -= 8;
+        }
+    }
+
+    /// Huffman codes are defined most-significant bit first, so reverse them
+    void code(uint32_t value, int length) {
+        uint32_t reversed = 0;
+        for (int i = 0; i < length; i++)
+            reversed |= ((value >> i) & 1) << (length - 1 - i);
+        bits(reversed, length);
+    }
+
+    void flush() {
+        if (used > 0)
+            out.push_back(buffer & 0xff);
+        buffer = 0;
+        used = 0;
+    }
+
+private:
+    vector<unsigned char>& out;
+    uint32_t buffer = 0;
+    int used = 0;
+};
+
+const int LENGTH_BASE[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+                             35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+const int LENGTH_EXTRA[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+                              3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+const int DIST_BASE[30] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+                           257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+                           8193, 12289, 16385, 24577};
+const int DIST_EXTRA[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+                            7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+const int WINDOW = 32768;
+const int MIN_MATCH = 3;
+const int MAX_MATCH = 258;
+const int HASH_BITS = 15;
+const int MAX_CHAIN = 16;
+
+/**
+ * Writes a literal/length symbol with the fixed Huffman code.
+ */
+void writeLiteral(BitWriter& w, int symbol) {
+    if (symbol < 144)
+        w.code(0x30 + symbol, 8);
+    else if (symbol < 256)
+        w.code(0x190 + symbol - 144, 9);
+    else if (symbol < 280)
+        w.code(symbol - 256, 7);
+    else
+        w.code(0xc0 + symbol - 280, 8);
+}
+
+void writeMatch(BitWriter& w, int length, int distance) {
+    int l = 28;
+    while (LENGTH_BASE[l] > length)
+        l--;
+    writeLiteral(w, 257 + l);
+    w.bits(length - LENGTH_BASE[l], LENGTH_EXTRA[l]);
+    int dc = 29;
+    while (DIST_BASE[dc] > distance)
+        dc--;
+    w.code(dc, 5);
+    w.bits(distance - DIST_BASE[dc], DIST_EXTRA[dc]);
+}
+
+uint32_t hash3(const unsigned char* p) {
+    return ((p[0] << 10) ^ (p[1] << 5) ^ p[2]) & ((1 << HASH_BITS) - 1);
+}
+
+uint32_t adler32(const unsigned char* data, size_t n) {
+    uint32_t a = 1, b = 0;
+    for (size_t i = 0; i < n; i++) {
+        a = (a + data[i]) % 65521;
+        b = (b + a) % 65521;
+    }
+    return (b << 16) | a;
+}
+
+void putBigEndian(vector<unsigned char>& out, uint32_t value) {
+    out.push_back(value >> 24);
+    out.push_back(value >> 16);
+    out.push_back(value >> 8);
+    out.push_back(value);
+}
+
+void putChunk(vector<unsigned char>& out, const char* type, const vector<unsigned char>& data) {
+    putBigEndian(out, data.size());
+    size_t start = out.size();
+    out.insert(out.end(), type, type + 4);
+    out.insert(out.end(), data.begin(), data.end());
+    putBigEndian(out, crc32(&out[start], out.size() - start));
+}
+
+} // namespace
+
+vector<unsigned char> ImageWriter::deflate(const unsigned char* data, size_t n) {
+    vector<unsigned char> out;
+    BitWriter w(out);
+    w.bits(1, 1); // BFINAL
+    w.bits(1, 2); // BTYPE = fixed Huffman
+
+    vector<int> head(1 << HASH_BITS, -1), prev(WINDOW, -1);
+    size_t i = 0;
+    while (i < n) {
+        int bestLength = 0, bestDistance = 0;
+        if (i + MIN_MATCH <= n) {
+            uint32_t h = hash3(data + i);
+            int candidate = head[h];
+            size_t limit = min((size_t)MAX_MATCH, n - i);
+            for (int chain = 0; candidate >= 0 && chain < MAX_CHAIN; chain++) {
+                if (i - candidate > (size_t)WINDOW - 1)
+                    break;
+                size_t length = 0;
+                while (length < limit && data[candidate + length] == data[i + length])
+                    length++;
+                if ((int)length > bestLength) {
+                    bestLength = length;
+                    bestDistance = i - candidate;
+                    if (length == limit)
+                        break;
+                }
+                int next = prev[candidate % WINDOW];
+                if (next >= candidate)
+                    break;
+                candidate = next;
+            }
+        }
+
+        int advance = 1;
+        if (bestLength >= MIN_MATCH) {
+            writeMatch(w, bestLength, bestDistance);
+            advance = bestLength;
+        } else {
+            writeLiteral(w, data[i]);
+        }
+        // Index every position we step over so later matches can find them
+        for (int a = 0; a < advance; a++, i++)
+            if (i + MIN_MATCH <= n) {
+                uint32_t h = hash3(data + i);
+                prev[i % WINDOW] = head[h];
+                head[h] = i;
+            }
+    }
+    writeLiteral(w, 256); // end of block
+    w.flush();
+    return out;
+}
+
+vector<unsigned char> ImageWriter::encodePNG(const unsigned char* pixels, int width, int height) {
+    static const unsigned char SIGNATURE[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    vector<unsigned char> png(SIGNATURE, SIGNATURE + 8);
+
+    vector<unsigned char> header;
+    putBigEndian(header, width);
+    putBigEndian(header, height);
+    header.push_back(8); // bit depth
+    header.push_back(0); // color type: grayscale
+    header.push_back(0); // compression
+    header.push_back(0); // filter method
+    header.push_back(0); // no interlace
+    putChunk(png, "IHDR", header);
+
+    // Each scanline is prefixed by its filter type (0 = none)
+    vector<unsigned char> raw;
+    raw.reserve((size_t)(width + 1) * height);
+    for (int row = 0; row < height; row++) {
+        raw.push_back(0);
+        raw.insert(raw.end(), pixels + (size_t)row * width, pixels + (size_t)(row + 1) * width);
+    }
+    vector<unsigned char> zlib = {0x78, 0x01};
+    vector<unsigned char> compressed = deflate(raw.data(), raw.size());
+    zlib.insert(zlib.end(), compressed.begin(), compressed.end());
+    putBigEndian(zlib, adler32(raw.data(), raw.size()));
+    putChunk(png, "IDAT", zlib);
+    putChunk(png, "IEND", {});
+    return png;
+}
+
+bool ImageWriter::write(const string& filename, const unsigned char* pixels, int width, int height, Format format) {
+    ofstream f(filename, ios::binary);
+    if (!f.is_open())
+        return false;
+    if (format == PNG) {
+        vector<unsigned char> png = encodePNG(pixels, width, height);
+        f.write(reinterpret_cast<const char*>(png.data()), png.size());
+    } else {
+        f << "P5\n" << width << " " << height << "\n255\n";
+        f.write(reinterpret_cast<const char*>(pixels), (size_t)width * height);
+    }
+    return (bool)f;
+}
+
+string ImageWriter::extension(Format format) {
+    return format == PNG ? "png" : "pgm";
+}
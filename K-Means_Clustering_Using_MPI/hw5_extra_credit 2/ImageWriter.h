@@ -0,0 +1,54 @@
+/**
+ * @file ImageWriter.h - writers for 8-bit grayscale images
+ *
+ * PNG files are encoded in-repo (zlib stream with fixed-Huffman deflate and a
+ * greedy LZ77 matcher), so no image library is needed. PGM (binary P5) is
+ * offered as the trivial uncompressed alternative.
+ */
+
+#pragma once
+#include <string>
+#include <vector>
+using namespace std;
+
+/**
+ * @class ImageWriter
+ * @brief Writes a row-major grayscale image to disk.
+ */
+class ImageWriter {
+public:
+    enum Format { PNG, PGM };
+
+    /**
+     * Writes an image.
+     * @param filename Path of the file to create
+     * @param pixels width x height gray values, row-major
+     * @param width Image width in pixels
+     * @param height Image height in pixels
+     * @param format PNG or PGM
+     * @return true if the file was written
+     */
+    static bool write(const string& filename, const unsigned char* pixels, int width, int height, Format format);
+
+    /**
+     * @return the file name extension (without the dot) for a format
+     */
+    static string extension(Format format);
+
+    /**
+     * Encodes an image as a PNG file in memory.
+     * @param pixels width x height gray values, row-major
+     * @param width Image width in pixels
+     * @param height Image height in pixels
+     * @return the complete PNG file
+     */
+    static vector<unsigned char> encodePNG(const unsigned char* pixels, int width, int height);
+
+    /**
+     * Compresses data as a single fixed-Huffman deflate block (RFC 1951).
+     * @param data bytes to compress
+     * @param n number of bytes
+     * @return raw deflate stream
+     */
+    static vector<unsigned char> deflate(const unsigned char* data, size_t n);
+};
@@ -0,0 +1,67 @@
+/**
+ * @file KMeansLog.h
+ * @brief Compile-time levelled logging for the k-means MPI code
+ *
+ * Messages above KMEANS_LOG_LEVEL are removed by the compiler, so trace output
+ * (per-point distances, centroid dumps) costs nothing in normal builds. Select a
+ * level with e.g. -DKMEANS_LOG_LEVEL=KMEANS_LOG_DEBUG.
+ *
+ * Each message is written as one logfmt line on stderr, tagged with the rank
+ * and seconds since the first message, so output from several ranks can be
+ * interleaved and still be sorted or filtered afterwards.
+ */
+#pragma once
+#include <chrono>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <mpi.h>
+using namespace std;
+
+#define KMEANS_LOG_OFF 0
+#define KMEANS_LOG_ERROR 1
+#define KMEANS_LOG_INFO 2
+#define KMEANS_LOG_DEBUG 3
+#define KMEANS_LOG_TRACE 4
+
+#ifndef KMEANS_LOG_LEVEL
+#define KMEANS_LOG_LEVEL KMEANS_LOG_INFO
+#endif
+
+/// Rank to tag messages from this thread with; -1 means ask MPI
+inline thread_local int kmeansLogRank = -1;
+
+/**
+ * Writes one log line.
+ * @param level name of the level
+ * @param message text of the message
+ */
+inline void kmeansLog(const char* level, const string& message) {
+    static const auto epoch = chrono::steady_clock::now();
+    int rank = kmeansLogRank, initialized = 0;
+    MPI_Initialized(&initialized);
+    if (rank < 0 && initialized)
+        MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    double t = chrono::duration<double>(chrono::steady_clock::now() - epoch).count();
+    ostringstream line;
+    line << "t=" << t << " rank=" << rank << " level=" << level << " msg=\"" << message << "\"\n";
+    cerr << line.str();
+}
+
+/**
+ * Log a message built with stream insertion, e.g. KLOG_DEBUG("generation " << g);
+ * The statement compiles away entirely when level is above KMEANS_LOG_LEVEL.
+ */
+#define KLOG(level, name, stuff) \
+    do { \
+        if constexpr ((level) <= KMEANS_LOG_LEVEL) { \
+            ostringstream kmeansLogStream; \
+            kmeansLogStream << stuff; \
+            kmeansLog(name, kmeansLogStream.str()); \
+        } \
+    } while (false)
+
+#define KLOG_ERROR(stuff) KLOG(KMEANS_LOG_ERROR, "error", stuff)
+#define KLOG_INFO(stuff) KLOG(KMEANS_LOG_INFO, "info", stuff)
+#define KLOG_DEBUG(stuff) KLOG(KMEANS_LOG_DEBUG, "debug", stuff)
+#define KLOG_TRACE(stuff) KLOG(KMEANS_LOG_TRACE, "trace", stuff)
@@ -5,36 +5,88 @@
  */
 #pragma once
 #include <vector>
+#include <cmath>
+#include <limits>
 #include <random>
 #include <algorithm>
+#include <numeric>
+#include <chrono>
+#include <thread>
 #include <array>
 #include <iostream>
 #include <mpi.h>
+#include "CentroidModel.h"
+#include "CentroidTree.h"
+#include "Communicator.h"
+#include "DistanceKernels.h"
+#include "KMeansLog.h"
+#include "KMeansProfiler.h"
+#include "ModelFile.h"
+#include "PackedPoints.h"
+#include "SparsePoints.h"
 using namespace std;
 
 /**
  * @class KMeansMPI
  * @brief Parallel k-means clustering using MPI
  *
- * @tparam k Number of clusters
- * @tparam d Dimensionality of each color data
+ * The number of clusters k is fixed at construction and the dimensionality d is
+ * taken from the data passed to fit, so one build handles any dataset shape.
+ * Points are unsigned char vectors stored row-major, d values per point, and may
+ * carry integer weights (e.g. pixel counts of unique colors); an unweighted point
+ * has weight 1.
+ *
+ * All communication goes through a Communicator: MPI_COMM_WORLD by default, or
+ * e.g. a SharedMemoryCommunicator to run the ranks as threads of one process.
+ *
+ * For very large n, setCoreset adds a pre-stage: the generations run on a small
+ * weighted sample drawn by sensitivity sampling, and only one assignment pass
+ * touches the full data (see buildCoreset).
+ *
+ * setAsynchronous replaces the lockstep generations with one-sided updates to
+ * a window at ROOT, so a slow rank no longer holds the others back every
+ * generation (see asynchronousGenerations).
  */
-
-template <int k, int d>
 class KMeansMPI {
 public:
-    virtual ~KMeansMPI() = default;
-
     // Definitions
     struct Cluster;
     const int MAX_NUM_GENERATIONS = 300;
-    using Element = array<unsigned char, d>; /// Represent a single data point
-    using Clusters = array<Cluster, k>; /// Collection of k clusters
+    using Clusters = vector<Cluster>; /// Collection of k clusters
+    using Phase = KMeansProfiler::Phase;
 
+    /// How points are stored for the distance computation
+    enum Representation {
+        AUTO,   ///< Sparse when the measured density is below sparseDensity(k)
+        DENSE,  ///< Always dense
+        SPARSE, ///< Always CSR
+        PACKED  ///< 4-bit values packed two per byte; never chosen by AUTO, since it is lossy
+    };
 
-    // Debugging flag
-    const bool VERBOSE = true;  // set to true for debugging output
-#define V(stuff) if(VERBOSE) {using namespace std; stuff}
+    /// Under AUTO, datasets with a smaller fraction of nonzero values use the sparse path
+    static constexpr double SPARSE_DENSITY = 0.12;
+    /// Threshold once k is wide enough (WIDE_K) for the sparse kernel to vectorize over centroids
+    static constexpr double SPARSE_DENSITY_WIDE_K = 0.4;
+    static constexpr int WIDE_K = 32;
+
+    /**
+     * Measured on MNIST (d = 784): dense wins at k = 10 above about 0.13 density,
+     * sparse wins at k = 64 even at the raw 0.33 density.
+     * @return density below which AUTO picks the sparse path for k clusters
+     */
+    static double sparseDensity(int k) {
+        return k >= WIDE_K ? SPARSE_DENSITY_WIDE_K : SPARSE_DENSITY;
+    }
+
+    /// How each point finds its nearest centroid during a fit
+    enum Search {
+        SEARCH_AUTO,        ///< kd-tree when d <= CentroidTree::MAX_DIMENSION and k >= TREE_MIN_K
+        SEARCH_BRUTE_FORCE, ///< Distances to all k centroids
+        SEARCH_KD_TREE      ///< CentroidTree, for any d
+    };
+
+    /// Under SEARCH_AUTO, low-dimensional fits with at least this many clusters use the kd-tree
+    static const int TREE_MIN_K = 128;
 
     /**
      * @struct Cluster
@@ -42,7 +94,8 @@ public:
     */
     struct Cluster {
         vector<int> elements; ///< Indices of elements belonging to the cluster
-        Element centroid;  ///< Cluster centroid
+        vector<unsigned char> centroid;  ///< Cluster centroid (d values)
+        int weight = 0;                  ///< Total weight of the elements (their count when unweighted), at ROOT
 
         /**
          * @brief Compares centroids of two clusters.
@@ -52,6 +105,39 @@ public:
         }
     };
 
+    /**
+     * @struct Tolerances
+     * @brief When a fit may stop before nothing changes; a tolerance of 0 is off.
+     *
+     * A fit always stops once no point changes cluster or no centroid moves, or
+     * after MAX_NUM_GENERATIONS. A nonzero tolerance also stops it at the
+     * first generation that meets it.
+     */
+    struct Tolerances {
+        double movedFraction = 0;   ///< Stop when fewer than this fraction of points change cluster
+        double centroidShift = 0;   ///< Stop when no centroid moves farther than this (Euclidean)
+        double inertiaChange = 0;   ///< Stop when inertia changes by less than this fraction
+    };
+
+    /**
+     * @struct GenerationStats
+     * @brief The convergence measures of one generation, identical on every rank.
+     */
+    struct GenerationStats {
+        int generation = 0;         ///< Generation number, from 0
+        long long moved = 0;        ///< Points, over all ranks, that changed cluster
+        double movedFraction = 0;   ///< moved over the number of points clustered
+        double centroidShift = 0;   ///< Largest Euclidean move of a centroid in the update
+        double inertia = 0;         ///< Weighted squared distances under this generation's labels
+    };
+
+    /**
+     * @param k Number of clusters
+     */
+    explicit KMeansMPI(int k) : k(k), clusters(k) {}
+
+    virtual ~KMeansMPI() = default;
+
     /**
      * @brief Retrieves the clusters computed from the last k-means iteration.
      * @return Reference to the computed clusters.
@@ -60,275 +146,1099 @@ public:
         return clusters;
     }
 
+    /**
+     * @return Number of clusters
+     */
+    int getK() const {
+        return k;
+    }
+
+    /**
+     * @return Dimensionality of the last fitted dataset (valid on every rank after fitWork)
+     */
+    int getDimension() const {
+        return d;
+    }
+
+    /**
+     * @brief Runs the ranks over a different communication backend.
+     * @param communicator Backend to use; must outlive every fit on this object
+     */
+    void setCommunicator(Communicator& communicator) {
+        comm = &communicator;
+    }
+
+    /**
+     * @brief Chooses how points are stored for the distance computation.
+     * @param representation AUTO (default), DENSE, SPARSE or PACKED
+     */
+    void setRepresentation(Representation representation) {
+        requested = representation;
+    }
+
+    /**
+     * @brief Chooses how points find their nearest centroid; both ways give the same labels.
+     * @param search SEARCH_AUTO (default), SEARCH_BRUTE_FORCE or SEARCH_KD_TREE
+     */
+    void setSearch(Search search) {
+        requestedSearch = search;
+    }
+
+    /**
+     * @return true if the last fit searched a kd-tree of the centroids
+     */
+    bool usesTree() const {
+        return useTree;
+    }
+
+    /**
+     * @return true if the last fit used the sparse (CSR) distance path
+     */
+    bool isSparse() const {
+        return sparse;
+    }
+
+    /**
+     * @return true if the last fit ran its distances on 4-bit packed points
+     */
+    bool isPacked() const {
+        return packed;
+    }
+
+    /**
+     * @brief Whether a PACKED fit finishes with exact generations.
+     *
+     * When on (the default), a PACKED fit that has converged on quantized
+     * distances carries on with exact ones until it converges again. Those last
+     * generations usually move few points, so the labels and inertia are exact
+     * while most generations still stream half the bytes. Refinement applies to
+     * lockstep fits, not asynchronous ones. Must be set identically on all ranks.
+     *
+     * @param on Whether to refine
+     */
+    void setPackedRefinement(bool on) {
+        packedRefinement = on;
+    }
+
+    /**
+     * @brief Turns throughput-weighted partitioning on or off.
+     *
+     * When on, every rank times its assignment work for the first few generations,
+     * then point ownership is rebalanced in proportion to the measured throughput
+     * so that slower ranks get fewer points. Must be set identically on all ranks.
+     *
+     * @param on Whether to rebalance
+     * @param measureGenerations Number of generations to time before rebalancing
+     */
+    void setAdaptivePartitioning(bool on, int measureGenerations = 2) {
+        adaptive = on;
+        rebalanceGeneration = measureGenerations;
+    }
+
+    /**
+     * @brief Writes a per-generation JSON profile at ROOT after every fit.
+     *
+     * Must be set identically on all ranks, since writing the report is collective.
+     * @param filename Report path, or empty to turn profiling reports off
+     */
+    void setProfileReport(const string& filename) {
+        profileReport = filename;
+    }
+
+    /**
+     * @brief Counts hardware events per phase, for getProfiler().totalCounts.
+     *
+     * Off by default, so that phases are only timed; the profile report holds
+     * times and bytes only.
+     * @param on Whether to count
+     */
+    void setHardwareCounters(bool on) {
+        countEvents = on;
+    }
+
+    /**
+     * @return Phase timings and bytes sent by this rank during the last fit
+     */
+    const KMeansProfiler& getProfiler() const {
+        return profiler;
+    }
+
+    /**
+     * @brief Lets fits stop once the clustering is close enough to stable.
+     *
+     * Must be set identically on all ranks. With the default all-zero tolerances a
+     * fit runs until no point changes cluster.
+     * @param tolerances Early-exit thresholds; zero turns a criterion off
+     */
+    void setTolerances(const Tolerances& tolerances) {
+        this->tolerances = tolerances;
+    }
+
+    /**
+     * @return The convergence measures of every generation of the last fit
+     */
+    const vector<GenerationStats>& getConvergenceHistory() const {
+        return history;
+    }
+
+    /**
+     * @brief Clusters a weighted sensitivity sample instead of the full data.
+     *
+     * When on and n is larger than points, each fit draws a coreset of about
+     * points weighted points across the ranks, runs its generations on it, then
+     * assigns every point of the full data once. For a (1 +- eps) approximation
+     * of the k-means cost of every solution, points should grow like d k log k / eps^2;
+     * a few hundred per cluster is typical. Must be set identically on all ranks.
+     *
+     * @param points Target coreset size, or 0 (default) to always use the full data
+     */
+    void setCoreset(int points) {
+        coresetTarget = max(0, points);
+    }
+
+    /**
+     * @return Points in the last fit's coreset, or 0 if it ran on the full data
+     */
+    int getCoresetSize() const {
+        return coresetSize;
+    }
+
+    /**
+     * @brief Lets ranks run their passes without waiting for each other.
+     *
+     * Each pass, a rank reads the latest cluster sums from a window at ROOT and
+     * adds its own changes back into it, instead of joining a gather and a broadcast.
+     * No rank may get more than staleness passes ahead of the slowest, so the
+     * centroids a rank works with are at most that many passes out of date. The
+     * fit stops once every rank has made a pass without moving a point under the
+     * current sums. Of the tolerances only movedFraction applies, to the latest
+     * pass of every rank taken together. No convergence history is kept, and
+     * getGenerations is this rank's own number of passes. Must be set identically
+     * on all ranks.
+     *
+     * @param staleness Passes a rank may run ahead, or 0 (default) for lockstep generations
+     */
+    void setAsynchronous(int staleness) {
+        this->staleness = max(0, staleness);
+    }
+
+    /**
+     * @brief Writes the labels of every fit to a file instead of gathering them at ROOT.
+     *
+     * The file holds one native-endian int per point in global order, so the label
+     * of point i is at byte i * sizeof(int). Every rank writes its own block at
+     * that offset with collective MPI-IO. ROOT then only receives the total weight
+     * of each cluster: getClusters has the centroids and weights, with empty
+     * element lists. If the file cannot be written, the labels are gathered at
+     * ROOT as usual. Must be set identically on all ranks.
+     *
+     * @param filename Labels file, or empty (default) to gather the labels at ROOT
+     */
+    void setLabelFile(const string& filename) {
+        labelFile = filename;
+    }
+
+    /**
+     * @param threads Upper bound on threads used by predict for large batches
+     */
+    void setPredictThreads(int threads) {
+        predictThreads = max(1, threads);
+    }
+
+    /**
+     * @brief Labels new points with their nearest fitted centroid.
+     *
+     * Uses the centroids of the last fit (available on every rank), so new data
+     * can be served without refitting. Each call is timed as one batch.
+     *
+     * @param points n row-major points of d values each, d as in the last fit
+     * @param n Number of points
+     * @param labels Output, the cluster index of each point
+     * @pre fit or fitWork has completed
+     */
+    virtual void predict(const unsigned char* points, int n, int* labels) {
+        auto start = chrono::steady_clock::now();
+        model.assign(points, n, labels, predictThreads, predictPool);
+        latency.record(chrono::duration<double>(chrono::steady_clock::now() - start).count(), n);
+    }
+
+    /**
+     * @return Batch latency percentiles and throughput of predict calls so far
+     */
+    PredictStats getPredictStats() const {
+        return latency.summarize();
+    }
+
+    /**
+     * @return Fitted centroids packed with their norms
+     */
+    const CentroidModel& getModel() const {
+        return model;
+    }
+
+    /**
+     * @return Weighted sum of squared distances from each point to its centroid in the
+     *         last fit's final assignment (valid on every rank)
+     */
+    double getInertia() const {
+        return inertia;
+    }
+
+    /**
+     * @return Generations the last fit took
+     */
+    int getGenerations() const {
+        return profiler.getGenerations();
+    }
+
+    /**
+     * @brief Saves the last fit's centroids, inertia and generation count.
+     * @param filename Model file to write
+     * @return true if written
+     * @pre fit or fitWork has completed
+     */
+    bool saveModel(const string& filename) const {
+        ModelFile file;
+        file.k = k;
+        file.d = d;
+        file.generations = getGenerations();
+        file.inertia = inertia;
+        file.centroids.assign(model.getCentroids(), model.getCentroids() + (size_t)k * d);
+        return file.save(filename);
+    }
+
+    /**
+     * @brief Seeds later fits with a saved model's centroids instead of random ones.
+     *
+     * Only needed at ROOT, which picks the initial centroids. The seed stays in effect
+     * for every fit whose dimensionality matches, until clearWarmStart.
+     * @param filename Model file written by saveModel
+     * @return false, leaving fits cold, if the file is missing, corrupt or has a different k
+     */
+    bool loadModel(const string& filename) {
+        ModelFile file;
+        if (!file.load(filename) || file.k != k) {
+            KLOG_ERROR("cannot warm start from " << filename);
+            return false;
+        }
+        warmStart = move(file);
+        return true;
+    }
+
+    /**
+     * @brief Goes back to random initial centroids.
+     */
+    void clearWarmStart() {
+        warmStart = ModelFile();
+    }
+
     /**
      * @brief Runs k-means clustering on the dataset.
      *
-     * @param colorList The dataset to cluster.
+     * @param colorList The dataset to cluster, n row-major points of d values each.
      * @param n The number of data points in the dataset.
+     * @param dim The dimensionality of each data point.
+     * @param weights Optional weight of each data point, or nullptr for all ones;
+     *                the total weight must fit in an int.
      */
-    virtual void fit(const Element* colorList, int n) {
+    virtual void fit(const unsigned char* colorList, int n, int dim, const int* weights = nullptr) {
         elements = colorList;
         nColors = n;
+        d = dim;
+        elementWeights = weights;
+        localPoints = nullptr;
         fitWork(ROOT);
     }
 
+    /**
+     * @brief Runs k-means on data that is already spread over the ranks.
+     *
+     * Every rank calls this with its own block instead of ROOT holding everything,
+     * so no rank ever needs the whole dataset. The global order of the points is
+     * rank 0's block, then rank 1's, and so on. ROOT still receives every label in
+     * getClusters.
+     *
+     * @param points This rank's n row-major points of dim values each
+     * @param n Number of points on this rank (may differ between ranks, may be 0)
+     * @param dim Dimensionality, the same on every rank
+     */
+    virtual void fitLocal(const unsigned char* points, int n, int dim) {
+        elements = nullptr;
+        elementWeights = nullptr;
+        localPoints = points;
+        localCount = n;
+        d = dim;
+        fitWork(comm->rank());
+    }
+
+    /**
+     * @param seed Seed for ROOT's choice of initial centroids, or 0 (default) for a
+     *             fresh random choice every fit
+     */
+    void setSeed(unsigned seed) {
+        this->seed = seed;
+    }
+
     /**
      * Per-process work for fitting
-     * @param rank Process rank within MPI_COMM_WORLD
-     * @pre n and elements are set in ROOT process; all p processes call fitWork simultaneously
-     * @post clusters are now stable (or we gave up after MAX_NUM_GENERATIONS)
+     * @param rank Rank of this process (or thread) within the communicator
+     * @pre n, d and elements are set in ROOT process; all p processes call fitWork simultaneously
+     *      (or all call fitLocal)
+     * @post clusters are now stable, within the tolerances (or we gave up after MAX_NUM_GENERATIONS)
      */
     virtual void fitWork(int rank) {
-        broadcastSize();
-        partitionColors(rank);
-        if (rank == ROOT)
+        profiler.reset();
+        profiler.setCounting(countEvents);
+        {
+            KMeansProfiler::Scope scope(profiler, Phase::PARTITION_COLORS);
+            broadcastSize();
+            partitionColors(rank);
+            reserveBuffers(rank);
+        }
+        bool summarized = coresetTarget > 0 && coresetTarget < nColors;
+        coresetSize = 0;
+        if (summarized)
+            profiled(Phase::PARTITION_COLORS, [&] { buildCoreset(); });
+        int warm = rank == ROOT && warmStart.k == k && warmStart.d == d;
+        if (localPoints != nullptr)
+            comm->broadcast(&warm, 1, sizeof(int), ROOT);
+        if (warm) {
+            if (rank == ROOT)
+                seedClusters();
+        } else if (localPoints != nullptr) {
+            selectLocalClusters(rank);
+        } else if (rank == ROOT) {
             selectClusters();
-        distributeCentroids(rank);
-        Clusters prev = clusters;
-        ++prev[0].centroid[0];  // just to make it different the first time
-        for (int generation = 0; generation < MAX_NUM_GENERATIONS; generation++) {
-            if (prev == clusters) {
-                break;
+        }
+        profiled(Phase::DISTRIBUTE_CENTROIDS, [&] { distributeCentroids(rank); });
+        history.clear();
+        balance = {};
+        bool rebalancing = adaptive && !summarized && staleness == 0;
+        if (staleness > 0)
+            asynchronousGenerations(rank);
+        for (int generation = 0; staleness == 0 && generation < MAX_NUM_GENERATIONS; generation++) {
+            profiler.beginGeneration();
+            if (rebalancing && generation == rebalanceGeneration)
+                profiled(Phase::REBALANCE_PARTITIONS, [&] { rebalancePartitions(rank); });
+            KLOG_DEBUG("working on generation " << generation);
+            double start = Communicator::wallTime();
+            profiled(Phase::UPDATE_DISTANCES, [&] { updateDistances(); });
+            previous = clusters;
+            profiled(Phase::UPDATE_CLUSTERS, [&] { updateClusters(); });
+            double computed = Communicator::wallTime();
+            profiled(Phase::COMBINE_CLUSTERS, [&] { combineClusters(rank); });
+            profiled(Phase::DISTRIBUTE_CENTROIDS, [&] { distributeCentroids(rank); });
+            recordGeneration(generation, computed - start, Communicator::wallTime() - start);
+            if (profiled(Phase::COMBINE_CLUSTERS, [&] { return converged(generation); })) {
+                if (!packed || refining || !packedRefinement)
+                    break;
+                KLOG_INFO("packed distances converged at generation " << generation << ", refining");
+                refining = true;
             }
-            V(cout<<rank<<" working on generation "<<generation<<endl;)
-            updateDistances();
-            prev = clusters;
-            updateClusters();
-            combineClusters(rank);
-            distributeCentroids(rank);
         }
-        collectClusterAssignments(rank);
-        colorIds = nullptr;
-        partition = nullptr;
-        delete[] colorIds;
-        delete[] partition;
-
+        profiler.beginFinal();
+        if (summarized) {
+            // The single pass over the full data: labels and inertia, centroids unchanged
+            restoreFullPartition();
+            profiled(Phase::UPDATE_DISTANCES, [&] { updateDistances(); });
+            profiled(Phase::UPDATE_CLUSTERS, [&] { updateClusters(); });
+        }
+        profiled(Phase::COMBINE_CLUSTERS, [&] { comm->allreduce(&localInertia, &inertia, 1, Communicator::SUM); });
+        if (rebalancing)
+            reportBalance(rank);
+        profiled(Phase::COLLECT_CLUSTER_ASSIGNMENTS, [&] { collectClusterAssignments(rank); });
+        if (summarized && rank == ROOT && labelFile.empty())
+            for (Cluster& cluster : clusters) {
+                cluster.weight = 0;
+                for (int i : cluster.elements)
+                    cluster.weight += weighted ? elementWeights[i] : 1;
+            }
+        packCentroids();
+        model = CentroidModel(centroidData.data(), k, d);
+        latency.clear();
+        if (!profileReport.empty())
+            profiler.writeReport(profileReport, *comm, ROOT);
     }
 
 protected:
     const int ROOT = 0;                      /// Total number of MPI processes
-    const Element* elements = nullptr;       /// Pointer to input data
-    Element* partition = nullptr;            /// Subset of data assigned to the process
-    int* colorIds = nullptr;                 /// locally track indices in this->elements
+    MPICommunicator mpiComm;                 /// Default backend: MPI_COMM_WORLD
+    Communicator* comm = &mpiComm;           /// Backend used for all collectives
+    int k;                                   /// Number of clusters
+    int d = 0;                               /// Dimensionality of each data point
+    const unsigned char* elements = nullptr; /// Pointer to input data (n x d, ROOT only)
+    unsigned char* partition = nullptr;      /// Subset of data assigned to the process (maxNum x d)
+    vector<unsigned char> partitionStore;    /// Storage behind partition, kept across fits
+    vector<unsigned char> migrationStore;    /// Incoming partition while rebalancing
+    vector<int> colorIds;                    /// locally track indices in this->elements
+    const int* elementWeights = nullptr;     /// Weight of each input point (ROOT only), or nullptr
+    const unsigned char* localPoints = nullptr; /// This rank's block under fitLocal, else nullptr
+    int localCount = 0;                      /// Number of points in localPoints
+    unsigned seed = 0;                       /// Seed for the initial centroids (0: random)
+    bool weighted = false;                   /// Whether the current fit has weights
+    vector<int> weights;                     /// Weight of each point in partition (all 1 when unweighted)
+    vector<int> assignment;                  /// Cluster of each partition point so far (-1: none yet)
+    vector<long long> deltaRecords;          /// This generation's change per cluster: k x [j, weight, d sums]
+    vector<char> changed;                    /// Whether a cluster gained or lost points this generation
+    vector<long long> globalSums;            /// Weighted coordinate sums per cluster (k x d, ROOT only)
+    vector<long long> globalWeights;         /// Total weight per cluster (ROOT only)
+    int moved = 0;                           /// Points on this rank that changed cluster this generation
+    Tolerances tolerances;                   /// Early-exit thresholds
+    int staleness = 0;                       /// Passes a rank may run ahead (0: lockstep generations)
+    vector<long long> windowView;            /// This rank's copy of ROOT's window
+    vector<GenerationStats> history;         /// Convergence measures of the last fit
+    vector<int> counts;                      /// Per-rank counts for v-collectives (reused)
+    vector<int> displs;                      /// Per-rank displacements for v-collectives (reused)
+    vector<int> changedRows;                 /// Rows of deltaRecords sent by combineClusters
+    vector<long long> combined;              /// Records received by combineClusters (ROOT)
+    vector<int> labels;                      /// Labels received by collectClusterAssignments (ROOT)
+    string labelFile;                        /// Where the labels are written (empty: gathered at ROOT)
+    vector<double> labelWeights;             /// Per-cluster weights, before and after the reduction
+    vector<void*> centroidBlocks;            /// Centroid vectors, as blocks for broadcastBlocks
     int nColors = 0;                         /// Total number of data points
     int maxNum = 0;                          /// Maximum number of elements handled per process
     int proccesses = 0;                      /// Total number of MPI processes
     Clusters clusters;                       /// Clustering results
-    vector<array<double,k>> dist;            /// Stores distances between points and centroids
+    Clusters previous;                       /// Clusters before the last update, for convergence
+    vector<double> dist;                     /// Distances between points and centroids (maxNum x k)
+    vector<unsigned char> centroidData;      /// Packed centroids (k x d) handed to the distance kernel
+    DistanceKernel kernel = nullptr;         /// Distance kernel selected for d
+    Representation requested = AUTO;         /// Representation asked for by the user
+    bool sparse = false;                     /// Whether this fit uses sparsePartition
+    SparsePoints sparsePartition;            /// CSR copy of partition when sparse
+    bool packed = false;                     /// Whether this fit uses packedPartition
+    bool packedRefinement = true;            /// Finish PACKED fits with exact generations
+    bool refining = false;                   /// Distances are exact again although packed
+    PackedPoints packedPartition;            /// 4-bit copy of partition when packed
+    vector<long long> centroidNorms;         /// |c|^2 per centroid for the sparse path
+    vector<unsigned char> centroidTransposed; /// Centroids as d x k for the sparse path
+    Search requestedSearch = SEARCH_AUTO;    /// Search asked for by the user
+    bool useTree = false;                    /// Whether this fit searches centroidTree
+    CentroidTree centroidTree;               /// kd-tree over the current centroids
+    vector<int> nearest;                     /// Nearest centroid per point when useTree
+    int coresetTarget = 0;                   /// Requested coreset size (0: off)
+    int coresetSize = 0;                     /// Global size of the last fit's coreset
+    vector<unsigned char> coreset;           /// This rank's share of the coreset (points x d)
+    unsigned char* fullPartition = nullptr;  /// partition, set aside while the coreset stands in
+    int fullMaxNum = 0;                      /// maxNum of the full partition
+    vector<int> fullWeights;                 /// weights of the full partition
+    SparsePoints fullSparse;                 /// sparsePartition of the full partition
+    double localInertia = 0;                 /// This rank's share of the inertia, from updateClusters
+    double inertia = 0;                      /// Inertia of the last fit, summed over all ranks
+    ModelFile warmStart;                     /// Saved model seeding fits at ROOT (k = 0: none)
+    vector<int> bounds;                      /// Partition z owns points [bounds[z], bounds[z + 1])
+    bool adaptive = false;                   /// Rebalance partitions by measured throughput
+    int rebalanceGeneration = 2;             /// Generation at which partitions are rebalanced
+    KMeansProfiler profiler;                 /// Phase timings and bytes sent on this rank
+    string profileReport;                    /// Where ROOT writes the JSON profile (empty: off)
+    bool countEvents = false;                /// Count hardware events per phase
+    CentroidModel model;                     /// Fitted centroids prepared for predict
+    LatencyRecorder latency;                 /// Batch latencies of predict
+    int predictThreads = max(1, (int)thread::hardware_concurrency()); /// Thread cap for predict
+    WorkerPool predictPool;                  /// Threads kept for predict between batches
+
+    /**
+     * @struct BalanceStats
+     * @brief Per-rank timing accumulated before and after rebalancing.
+     */
+    struct BalanceStats {
+        double compute[2] = {0, 0};  ///< Seconds in updateDistances + updateClusters
+        double total[2] = {0, 0};    ///< Seconds for whole generations
+        int generations[2] = {0, 0}; ///< Generations timed
+        int points[2] = {0, 0};      ///< Points owned
+    } balance;
+
+    /// Minimum relative change in any partition size worth migrating points for
+    static constexpr double REBALANCE_THRESHOLD = 0.05;
+
+    /**
+     * @brief Runs one phase of the fit under the profiler.
+     * @param phase Phase to charge the time to
+     * @param work The phase itself
+     * @return whatever work returns
+     */
+    template <typename Work>
+    auto profiled(Phase phase, Work work) -> decltype(work()) {
+        KMeansProfiler::Scope scope(profiler, phase);
+        return work();
+    }
+
+    /**
+     * @brief Picks the distance kernel for the current dimensionality.
+     *
+     * Subclasses can override this to plug in a different metric.
+     * @return kernel computing point-to-centroid distances
+     */
+    virtual DistanceKernel selectKernel() const {
+        return selectDistanceKernel(d);
+    }
+
+    /**
+     * @brief Index of the first point owned by a process.
+     * @param z MPI rank
+     */
+    int partitionStart(int z) const {
+        return bounds[z];
+    }
+
+    /**
+     * @brief Number of points owned by a process; the last one takes the remainder.
+     * @param z MPI rank
+     */
+    int partitionSize(int z) const {
+        return bounds[z + 1] - bounds[z];
+    }
 
     /**
-      * @brief Distribute the dataset size across MPI processes.
+      * @brief Distribute the dataset size, dimensionality, whether it is weighted and
+      * whether it is already spread over the ranks (fitLocal).
       */
     virtual void broadcastSize() {
-        MPI_Bcast(&nColors, 1, MPI_INT, ROOT, MPI_COMM_WORLD);
+        int shape[4] = {nColors, d, elementWeights != nullptr, localPoints != nullptr};
+        comm->broadcast(shape, 4, sizeof(int), ROOT);
+        nColors = shape[0];  // under fitLocal, replaced by the total in partitionColors
+        d = shape[1];
+        weighted = shape[2];
+        if (!shape[3])
+            localPoints = nullptr;  // left over from an earlier fitLocal on this rank
+        kernel = selectKernel();
+        useTree = requestedSearch == SEARCH_KD_TREE
+            || (requestedSearch == SEARCH_AUTO && d <= CentroidTree::MAX_DIMENSION && k >= TREE_MIN_K);
+        for (Cluster& cluster : clusters)
+            cluster.centroid.assign(d, 0);
+        centroidData.resize((size_t)k * d);
     }
 
     /**
      * @brief Distributes dataset among MPI processes using scatter.
      *
-     * Each process receives a subset of elements to process. The root process
-     * first prepares the data and partitions it accordingly.
+     * Each process receives a contiguous block of elements to process, so the
+     * global index of a local element is just the block start plus its offset.
      *
      * @param rank MPI rank of the current process.
      */
     virtual void partitionColors(int rank) {
-        MPI_Comm_size(MPI_COMM_WORLD, &proccesses);
-        unsigned char* sendbuf = nullptr,
-        *recvbuf = nullptr;
-        int* sendcounts = nullptr,
-        *displs = nullptr;
-        int colorsEachProcess= nColors / proccesses;
-
-        // Root process prepares data for scattering
+        proccesses = comm->size();
+        counts.resize(proccesses);
+        displs.resize(proccesses);
+
+        bounds.resize(proccesses + 1);
+        if (localPoints != nullptr) {
+            // fitLocal: the blocks are where the caller put them
+            comm->allgather(&localCount, 1, counts.data(), sizeof(int));
+            bounds[0] = 0;
+            for (int z = 0; z < proccesses; z++)
+                bounds[z + 1] = bounds[z] + counts[z];
+            nColors = bounds[proccesses];
+        } else {
+            // Equal blocks to start with; the last process takes the remainder
+            int colorsEachProcess = nColors / proccesses;
+            for (int z = 0; z < proccesses; z++)
+                bounds[z] = z * colorsEachProcess;
+            bounds[proccesses] = nColors;
+        }
+
+        // Displacement and count for each process
+        for (int z = 0; z < proccesses; z++) {
+            displs[z] = partitionStart(z);
+            counts[z] = partitionSize(z);
+        }
+
+        // Set maxNum for the current process
+        maxNum = partitionSize(rank);
+        resizeAssignments();
+
+        // Scatter data straight into the partition
+        partitionStore.resize((size_t)maxNum * d);
+        partition = partitionStore.data();
+        if (localPoints != nullptr) {
+            copy(localPoints, localPoints + (size_t)maxNum * d, partition);
+        } else {
+            if (rank == ROOT)
+                profiler.addBytes(Phase::PARTITION_COLORS, 4 * sizeof(int)
+                                  + (double)nColors * (d + (weighted ? sizeof(int) : 0)));
+            comm->scatterv(
+                elements, counts.data(), displs.data(),
+                partition, maxNum, d, // one element per point
+                ROOT
+            );
+        }
+        weights.assign(maxNum, 1);
+        if (weighted)
+            comm->scatterv(elementWeights, counts.data(), displs.data(), weights.data(), maxNum, sizeof(int), ROOT);
+
+        colorIds.resize(maxNum);
+        iota(colorIds.begin(), colorIds.end(), partitionStart(rank));
+
+        // No point belongs to a cluster yet, so the first generation moves them all
+        assignment.assign(maxNum, -1);
         if (rank == ROOT) {
-            sendbuf = new unsigned char[nColors * (d + 1)];
-            sendcounts = new int[proccesses];
-            displs = new int[proccesses];
-            int index = 0;
-            for (int i = 0; i < nColors; i++) {
-                for (int j = 0; j < d; j++)
-                    sendbuf[index++] = elements[i][j]; // Store color data
-                sendbuf[index++] = (unsigned char)i; // Store index
+            globalSums.assign((size_t)k * d, 0);
+            globalWeights.assign(k, 0);
+            for (Cluster& cluster : clusters)
+                cluster.weight = 0;
+        }
+
+        chooseRepresentation();
+    }
+
+    /**
+     * @brief Sizes every per-generation buffer for this fit up front.
+     *
+     * Generations then only reuse memory: updateClusters, combineClusters and
+     * distributeCentroids never allocate, however many clusters change. Capacity
+     * is kept between fits, so refitting data of the same shape allocates nothing
+     * here either. The delta records are cleared here once per fit; after that
+     * updateClusters clears only the rows that changed. The one cost per
+     * generation left is in MPICommunicator::gathervIndexed, which commits a new
+     * layout when the set of changed clusters differs from the last generation's.
+     *
+     * @param rank The rank of the current process.
+     */
+    void reserveBuffers(int rank) {
+        const int RECORD = d + 2;
+        deltaRecords.assign((size_t)k * RECORD, 0);
+        for (int j = 0; j < k; j++)
+            deltaRecords[(size_t)j * RECORD] = j;
+        changed.assign(k, 0);
+        changedRows.reserve(k);
+        centroidBlocks.reserve(k);
+        previous.resize(k);
+        for (Cluster& cluster : previous)
+            cluster.centroid.reserve(d);
+        if (rank == ROOT) {
+            combined.reserve((size_t)proccesses * k * RECORD);  // every rank changes every cluster
+            labels.reserve(nColors);
+        }
+        profiler.reserve(MAX_NUM_GENERATIONS);
+        history.reserve(MAX_NUM_GENERATIONS);
+    }
+
+    /**
+     * @brief Records this generation's convergence measures and decides whether to stop.
+     *
+     * One allreduce totals the moved points, the points clustered and the inertia.
+     * Every rank holds the centroids before (previous) and after the update, so
+     * the centroid shift needs no communication, and all ranks reach the same
+     * decision.
+     *
+     * Besides the tolerances, the fit stops when no point moved, or when no
+     * centroid moved even though points did. Centroids are whole bytes, so the
+     * points that moved can leave every centroid where it was. The next
+     * generation would then compute the same distances from the same centroids,
+     * make the same assignment and move nothing: the labels already name each
+     * point's nearest centroid, and one more generation changes nothing.
+     *
+     * @param generation Generation that just finished
+     * @return true if the fit has converged
+     */
+    bool converged(int generation) {
+        double local[3] = {(double)moved, (double)maxNum, localInertia}, global[3];
+        comm->allreduce(local, global, 3, Communicator::SUM);
+        double shift = 0;
+        for (int j = 0; j < k; j++) {
+            const unsigned char* before = previous[j].centroid.data();
+            shift = max(shift, (double)squaredDistance(before, clusters[j].centroid.data(), d));
+        }
+
+        GenerationStats stats;
+        stats.generation = generation;
+        stats.moved = global[0];
+        stats.movedFraction = global[1] > 0 ? global[0] / global[1] : 0;
+        stats.centroidShift = sqrt(shift);
+        stats.inertia = global[2];
+        double inertiaChange = history.empty() || history.back().inertia == 0 ? 1
+            : abs(history.back().inertia - stats.inertia) / history.back().inertia;
+        history.push_back(stats);
+        KLOG_DEBUG("generation " << generation << ": " << stats.moved << " moved (" << stats.movedFraction
+                   << "), shift " << stats.centroidShift << ", inertia " << stats.inertia);
+
+        bool fixedPoint = stats.moved == 0 || shift == 0;  // see above: the next generation would move nothing
+        return fixedPoint
+            || (tolerances.movedFraction > 0 && stats.movedFraction < tolerances.movedFraction)
+            || (tolerances.centroidShift > 0 && stats.centroidShift <= tolerances.centroidShift)
+            || (tolerances.inertiaChange > 0 && inertiaChange < tolerances.inertiaChange);
+    }
+
+    /**
+     * @brief Replaces this rank's partition with its share of a sensitivity-sampled coreset.
+     *
+     * Sensitivity sampling (Feldman and Langberg; Bachem, Lucic and Krause):
+     *
+     * 1. A rough solution B: k-means++ seeding of k centers from the rank's points.
+     * 2. Each point x, in cluster b of B, gets an upper bound on how much it can
+     *    matter to the cost of any k centers:
+     *        s(x) = a D(x) / c + 2 a C(b) / (W(b) c) + 4 W / W(b)
+     *    D(x) is its squared distance to B and a = 16 (ln k + 2).
+     *    C(b) and W(b) are the cost and weight of b. c is the mean cost and W the
+     *    total weight of the rank.
+     * 3. The ranks allreduce their total sensitivity mass S. Each rank draws its
+     *    share of the m coreset points i.i.d. with probability proportional to
+     *    w(x) s(x). A drawn point carries weight S / (m s(x)), so the coreset's cost
+     *    for any centers is an unbiased estimate of the full cost.
+     *
+     * The union of the ranks' samples is a coreset of the whole dataset. It stays
+     * distributed, with each rank's sample as its partition, so the generations
+     * and the reduction in combineClusters run unchanged on it.
+     * restoreFullPartition puts the full partition back.
+     */
+    void buildCoreset() {
+        // 1. k-means++ seeding; cost[i] and owner[i] track the nearest seed so far
+        int centers = min(k, maxNum);
+        vector<double> cost(maxNum, numeric_limits<double>::max());
+        vector<int> owner(maxNum, 0);
+        vector<unsigned char> center(d);
+        // Reproducible under setSeed, with a different stream on each rank
+        mt19937_64 rng(seed != 0 ? (unsigned long long)seed + comm->rank() : random_device{}());
+        double totalWeight = 0, totalCost = 0;
+        for (int i = 0; i < maxNum; i++)
+            totalWeight += weights[i];
+        for (int c = 0; c < centers; c++) {
+            // The first seed is drawn by weight, the others by weighted squared distance
+            double target = uniform_real_distribution<double>(0, c == 0 ? totalWeight : totalCost)(rng);
+            int pick = 0;
+            for (double acc = 0; pick < maxNum - 1; pick++) {
+                acc += c == 0 ? weights[pick] : weights[pick] * cost[pick];
+                if (acc > target)
+                    break;
             }
-            // Compute displacement and count for each process
-            for (int z = 0; z < proccesses; z++) {
-                displs[z] = z * colorsEachProcess* (d + 1);
-                sendcounts[z] = colorsEachProcess* (d + 1);
-                if (z == proccesses - 1)
-                    sendcounts[z] = index - ((proccesses - 1) * colorsEachProcess* (d + 1));
+            copy(partition + (size_t)pick * d, partition + (size_t)(pick + 1) * d, center.begin());
+            totalCost = 0;
+            for (int i = 0; i < maxNum; i++) {
+                double distance = squaredDistance(partition + (size_t)i * d, center.data(), d);
+                if (distance < cost[i]) {
+                    cost[i] = distance;
+                    owner[i] = c;
+                }
+                totalCost += weights[i] * cost[i];
             }
         }
 
-        // Set maxNum for the current process
-        maxNum = colorsEachProcess;
-        if (rank == proccesses - 1)
-            maxNum = nColors - (colorsEachProcess* (proccesses - 1));
-        dist.resize(maxNum);
-
-        // Allocate buffer for receiving scattered data
-        int recvcount = maxNum * (d + 1);
-        recvbuf = new unsigned char[recvcount];
-
-        // Scatter data to all processes
-        MPI_Scatterv(
-            sendbuf, sendcounts, displs, MPI_UNSIGNED_CHAR,
-            recvbuf, recvcount, MPI_UNSIGNED_CHAR,
-            ROOT, MPI_COMM_WORLD
-        );
-
-        // Unmarshal received data
-        partition = new Element[maxNum];
-        colorIds = new int[maxNum];
-        int index = 0;
+        // 2. Sensitivity bound, times weight, per point
+        vector<double> clusterWeight(centers, 0), clusterCost(centers, 0), mass(maxNum);
         for (int i = 0; i < maxNum; i++) {
-            for (int j = 0; j < d; j++)
-                partition[i][j] = recvbuf[index++];
-            colorIds[i] = (int)recvbuf[index++];
+            clusterWeight[owner[i]] += weights[i];
+            clusterCost[owner[i]] += weights[i] * cost[i];
         }
+        double alpha = 16 * (log(k) + 2), average = totalWeight > 0 ? totalCost / totalWeight : 0;
+        double localMass = 0;
+        for (int i = 0; i < maxNum; i++) {
+            int b = owner[i];
+            double sensitivity = 4 * totalWeight / clusterWeight[b];
+            if (average > 0)
+                sensitivity += alpha * cost[i] / average + 2 * alpha * clusterCost[b] / (clusterWeight[b] * average);
+            mass[i] = weights[i] * sensitivity;
+            localMass += mass[i];
+        }
+
+        // 3. This rank's share of the draws, walked off the cumulative mass in sorted order
+        double globalMass;
+        comm->allreduce(&localMass, &globalMass, 1, Communicator::SUM);
+        int draws = globalMass > 0 ? (int)llround(coresetTarget * localMass / globalMass) : 0;
+        vector<double> targets(draws);
+        uniform_real_distribution<double> uniform(0, localMass);
+        for (double& target : targets)
+            target = uniform(rng);
+        sort(targets.begin(), targets.end());
+        coreset.clear();
+        vector<int> sampleWeights;
+        int i = 0, last = -1;
+        double acc = maxNum > 0 ? mass[0] : 0;
+        for (double target : targets) {
+            while (acc < target && i < maxNum - 1)
+                acc += mass[++i];
+            // weight S / (m s(x)), with s(x) = mass / w(x)
+            int weight = max(1, (int)llround(globalMass * weights[i] / (coresetTarget * mass[i])));
+            if (i == last) {
+                sampleWeights.back() += weight;  // drawn again: one point, more weight
+                continue;
+            }
+            coreset.insert(coreset.end(), partition + (size_t)i * d, partition + (size_t)(i + 1) * d);
+            sampleWeights.push_back(weight);
+            last = i;
+        }
+
+        // The sample stands in for the partition until restoreFullPartition
+        fullPartition = partition;
+        fullMaxNum = maxNum;
+        fullWeights = move(weights);
+        partition = coreset.data();
+        maxNum = sampleWeights.size();
+        weights = move(sampleWeights);
+        assignment.assign(maxNum, -1);
+        swap(sparsePartition, fullSparse);
+        if (sparse)
+            sparsePartition.build(partition, maxNum, d);
+        if (packed)
+            packedPartition.build(partition, maxNum, d);
+        resizeAssignments();
 
-        // Clean up allocated memory
-        delete[] sendbuf;
-        delete[] recvbuf;
-        delete[] sendcounts;
-        delete[] displs;
+        double sizes[2] = {(double)maxNum, (double)fullMaxNum}, totals[2];
+        comm->allreduce(sizes, totals, 2, Communicator::SUM);
+        coresetSize = totals[0];
+        KLOG_INFO("coreset of " << coresetSize << " points for " << totals[1] << " (" << maxNum << " on this rank)");
     }
 
     /**
-     * @brief Merges cluster centroids from all MPI processes.
+     * @brief Puts back the full partition set aside by buildCoreset, with no point assigned.
+     */
+    void restoreFullPartition() {
+        partition = fullPartition;
+        maxNum = fullMaxNum;
+        weights = move(fullWeights);
+        swap(sparsePartition, fullSparse);
+        refining = true;  // one pass is not worth packing for; it is exact
+        assignment.assign(maxNum, -1);
+        resizeAssignments();
+    }
+
+    /**
+     * @brief Merges this generation's cluster changes from all MPI processes.
      *
-     * Each process sends its cluster centroids to the root process, which then averages
-     * the centroids to update the global cluster centroids.
+     * ROOT keeps the exact weighted sums of every cluster across generations. Each
+     * process sends only the clusters whose membership changed on it: the changed
+     * rows of deltaRecords, each [cluster, weight delta, d sum deltas], picked out
+     * in place by gathervIndexed, so the message shrinks with the number of points
+     * that moved. ROOT applies the deltas and recomputes just the changed centroids;
+     * a cluster left without points keeps its last centroid.
      *
      * @param rank The MPI rank of the current process.
      */
     virtual void combineClusters(int rank) {
+        const int RECORD = d + 2;
+        changedRows.clear();
+        for (int j = 0; j < k; j++)
+            if (changed[j])
+                changedRows.push_back(j);
 
-        int sendCount = k * (d + 1), recvCount = proccesses * sendCount;
-        unsigned char* sendbuf = new unsigned char[sendCount], *recvbuf = nullptr;
+        // Record counts first, so ROOT can size the gatherv
+        int sendCount = changedRows.size();
+        comm->gather(&sendCount, 1, counts.data(), sizeof(int), ROOT);
+        int recvCount = 0;
+        if (rank == ROOT)
+            for (int z = 0; z < proccesses; z++) {
+                displs[z] = recvCount;
+                recvCount += counts[z];
+            }
+        combined.resize((size_t)recvCount * RECORD);
+        profiler.addBytes(Phase::COMBINE_CLUSTERS, sizeof(int) + (double)sendCount * RECORD * sizeof(long long));
+        comm->gathervIndexed(deltaRecords.data(), changedRows.data(), sendCount, combined.data(),
+                             counts.data(), displs.data(), RECORD * sizeof(long long), ROOT);
 
-        // Serialize local cluster centroids
-        int index = 0;
-        for (int i = 0; i < k; i++) {
-            for (int j = 0; j < d; j++)
-                sendbuf[index++] = clusters[i].centroid[j];
-            sendbuf[index++] = clusters[i].elements.size();
+        if (rank == ROOT) {
+            vector<char>& touched = changed;  // keeps ROOT's own flags set, for updateClusters
+            fill(touched.begin(), touched.end(), 0);
+            for (int r = 0; r < recvCount; r++) {
+                const long long* record = &combined[(size_t)r * RECORD];
+                int j = record[0];
+                globalWeights[j] += record[1];
+                for (int t = 0; t < d; t++)
+                    globalSums[(size_t)j * d + t] += record[2 + t];
+                touched[j] = 1;
+            }
+            for (int j = 0; j < k; j++) {
+                long long w = globalWeights[j];
+                if (!touched[j])
+                    continue;
+                clusters[j].weight = w;
+                setCentroid(j, w, &globalSums[(size_t)j * d]);
+            }
         }
+    }
 
-        if (rank == ROOT)
-            recvbuf = new unsigned char[recvCount];
+    /**
+     * @brief Moves centroid j to the rounded mean of its cluster, unless the cluster is empty.
+     * @param j Cluster
+     * @param w Total weight of the cluster
+     * @param sum Its d weighted coordinate sums
+     */
+    void setCentroid(int j, long long w, const long long* sum) {
+        // Sums read while another rank is halfway through an update can be off; clamp them
+        for (int t = 0; w > 0 && t < d; t++)
+            clusters[j].centroid[t] = (unsigned char)clamp((sum[t] + w / 2) / w, 0LL, 255LL);
+    }
 
-        // Gather all cluster data at the root process
-        MPI_Gather(
-            sendbuf, sendCount, MPI_UNSIGNED_CHAR,
-            recvbuf, sendCount, MPI_UNSIGNED_CHAR,
-            ROOT, MPI_COMM_WORLD
-        );
+    /**
+     * @brief Runs the passes of an asynchronous fit (setAsynchronous).
+     *
+     * ROOT's window holds, for each cluster, its total weight and weighted
+     * coordinate sums (k x [weight, d sums]). They are followed by counters: a
+     * version (the points moved so far, over all ranks), the points over all
+     * ranks, and per rank its passes, the version its last pass found clean (+1,
+     * or 0 if it moved points) and the points that pass moved.
+     *
+     * A pass on one rank:
+     *   1. Read the sums and set the centroids (the first pass uses the initial
+     *      centroids instead).
+     *   2. Assign points as in a synchronous generation.
+     *   3. Update this rank's clean slot, then add its changed rows into the sums,
+     *      then add the points it moved to the version, with a flush between each.
+     *      A rank that moves points withdraws its claim before its rows land, and
+     *      its rows land before the version that covers them.
+     *   4. Read the counters. Stop if every rank still running is clean at the
+     *      current version, or if tolerances.movedFraction is set and the latest
+     *      passes of all ranks moved fewer than that fraction of the points.
+     *      Otherwise wait until the slowest rank is at most staleness passes
+     *      behind. The version read here is the one the next pass claims; its
+     *      sums are read after it, so a pass can only claim to be clean at an
+     *      older version than its sums, never a newer one.
+     *
+     * Nobody waits for a rank that has stopped: its pass count jumps by
+     * MAX_NUM_GENERATIONS. At the end ROOT's sums are complete and exact, so the
+     * final centroids are the means of the final labels, as in the synchronous fit.
+     *
+     * @param rank The rank of the current process.
+     */
+    void asynchronousGenerations(int rank) {
+        const int RECORD = d + 2, ROW = d + 1;
+        const int VERSION = k * ROW, POINTS = VERSION + 1, PASSES = POINTS + 1;
+        const int CLEAN = PASSES + proccesses, LATEST = CLEAN + proccesses, WINDOW = LATEST + proccesses;
+        comm->openWindow(rank == ROOT ? WINDOW : 0);
+        windowView.resize(WINDOW);
+        const long long* passes = &windowView[PASSES];
+        const long long* clean = &windowView[CLEAN];
+        const long long* latest = &windowView[LATEST];
+        long long version = 0, claimed = 0, reported = 0, points = maxNum;
+        comm->accumulate(&points, 1, ROOT, POINTS);
+        comm->flush(ROOT);  // counted before this rank's first pass is
+        for (int generation = 0; generation < MAX_NUM_GENERATIONS; generation++) {
+            profiler.beginGeneration();
+            if (generation > 0)  // the first pass uses the initial centroids
+                profiled(Phase::DISTRIBUTE_CENTROIDS, [&] {
+                    comm->fetch(windowView.data(), VERSION, ROOT, 0);
+                    for (int j = 0; j < k; j++)
+                        setCentroid(j, windowView[(size_t)j * ROW], &windowView[(size_t)j * ROW + 1]);
+                    profiler.addBytes(Phase::DISTRIBUTE_CENTROIDS, (double)VERSION * sizeof(long long));
+                });
 
-        // Root process averages the centroids
-        if (rank == ROOT) {
-            array<int, k> clusterSizes = {}; // Initialize cluster sizes
-            for (int i = 0; i < k; i++)
-                clusterSizes[i] = clusters[i].elements.size();
+            profiled(Phase::UPDATE_DISTANCES, [&] { updateDistances(); });
+            profiled(Phase::UPDATE_CLUSTERS, [&] { updateClusters(); });
 
-            // Compute the averaged centroids
-            index = 0;
-            for (int z = 0; z < proccesses; z++)
-                for (int i = 0; i < k; i++) {
-                    Element centroid = Element{}; // Temporary centroid storage
-
-                    // Extract centroid values
-                    for (int j = 0; j < d; j++)
-                        centroid[j] = recvbuf[index++]; // Extract cluster size
-                    int size = (int)recvbuf[index++];
-
-                    // Update centroid by averaging values
-                    updateCentroid(
-                        clusters[i].centroid,
-                        clusterSizes[i],
-                        centroid, size
-                    );
-                    clusterSizes[i] += size; // Update total count
+            profiled(Phase::COMBINE_CLUSTERS, [&] {
+                long long claim = moved == 0 ? version + 1 : 0, pass = 1, movedNow = moved;
+                long long withdrawn = claim - claimed, replaced = movedNow - reported;
+                claimed = claim;
+                reported = movedNow;
+                comm->accumulate(&withdrawn, 1, ROOT, CLEAN + rank);
+                comm->accumulate(&replaced, 1, ROOT, LATEST + rank);
+                comm->accumulate(&pass, 1, ROOT, PASSES + rank);
+                comm->flush(ROOT);
+                int rows = 0;
+                for (int j = 0; j < k; j++)
+                    if (changed[j]) {
+                        comm->accumulate(&deltaRecords[(size_t)j * RECORD + 1], ROW, ROOT, j * ROW);
+                        rows++;
+                    }
+                comm->flush(ROOT);
+                comm->accumulate(&movedNow, 1, ROOT, VERSION);
+                comm->flush(ROOT);
+                profiler.addBytes(Phase::COMBINE_CLUSTERS, (4 + (double)rows * ROW) * sizeof(long long));
+            });
+
+            bool settled = profiled(Phase::DISTRIBUTE_CENTROIDS, [&] {
+                for (;;) {
+                    comm->fetch(&windowView[VERSION], WINDOW - VERSION, ROOT, VERSION);
+                    bool done = true;
+                    long long slowest = generation + 1, recent = 0;
+                    for (int z = 0; z < proccesses; z++) {
+                        bool stopped = passes[z] >= MAX_NUM_GENERATIONS;
+                        done = done && (stopped || clean[z] == windowView[VERSION] + 1);
+                        slowest = min(slowest, passes[z]);
+                        recent += latest[z];
+                    }
+                    done = done || (tolerances.movedFraction > 0 && slowest > 0
+                                    && recent < tolerances.movedFraction * windowView[POINTS]);
+                    if (done || generation + 1 - slowest <= staleness)
+                        return done;
+                    this_thread::yield();
                 }
+            });
+            if (settled)
+                break;
+            version = windowView[VERSION];
         }
-        // Free allocated memory
-        delete[] sendbuf;
-        if (rank == ROOT) {
-            delete[] recvbuf;
-        }
+
+        profiled(Phase::COMBINE_CLUSTERS, [&] {
+            long long stop = MAX_NUM_GENERATIONS;
+            comm->accumulate(&stop, 1, ROOT, PASSES + rank);
+            comm->flush(ROOT);
+            comm->barrier();
+            if (rank == ROOT) {
+                comm->fetch(windowView.data(), VERSION, ROOT, 0);
+                for (int j = 0; j < k; j++) {
+                    const long long* row = &windowView[(size_t)j * ROW];
+                    globalWeights[j] = row[0];
+                    copy(row + 1, row + ROW, &globalSums[(size_t)j * d]);
+                    clusters[j].weight = row[0];
+                    setCentroid(j, row[0], row + 1);
+                }
+            }
+            comm->closeWindow();
+        });
+        profiled(Phase::DISTRIBUTE_CENTROIDS, [&] { distributeCentroids(rank); });
     }
 
     /**
      * @brief Gather all assigned elements per cluster across MPI processes.
      *
-     * Each process sends its assigned cluster elements to the root process,
-     * which then consolidates all assignments into the global clusters.
+     * Each process sends the cluster label of every point it owns to the root
+     * process, which then consolidates all assignments into the global clusters.
      *
      * @param rank The MPI rank of the current process.
      */
     virtual void collectClusterAssignments(int rank) {
-        int sendcount = maxNum + k; // Each process sends its max elements + k cluster sizes
-        unsigned char* sendbuf = new unsigned char[sendcount], *recvbuf = nullptr;
-        int* recvcounts = nullptr, *displs = nullptr;
-        int bufferIndex = 0;
-
-        // Serialize cluster assignments
-        for (int i = 0; i < k; i++) {
-            sendbuf[bufferIndex++] = (unsigned char)clusters[i].elements.size(); // Store cluster size
-            for (const auto& index : clusters[i].elements) {
-                sendbuf[bufferIndex++] = static_cast<unsigned char>(colorIds[index]); // Store assigned element indices
-            }
+        if (!labelFile.empty() && writeAssignments(rank))
+            return;
 
-        }
-
-        // Root process allocates buffers to collect results
+        // Root collects one label per point, in global order, straight from assignment
         if (rank == ROOT) {
-            recvbuf = new unsigned char[nColors + k * proccesses]; // Allocate buffer to hold all cluster assignments
-            recvcounts = new int[proccesses]; // Store number of elements received from each process
-            displs = new int[proccesses]; // Store displacement index for MPI_Gatherv
-
-            int colorsEachProcess= nColors / proccesses;
-
-            // Compute displacements and receive counts
+            labels.resize(nColors);
             for (int z = 0; z < proccesses; z++) {
-                recvcounts[z] = colorsEachProcess+ k;
-                if (z == proccesses - 1) {
-                    // Last process gets the remaining elements
-                    recvcounts[z] = (nColors - (colorsEachProcess* (proccesses - 1))) + k;
-                }
-                displs[z] = z * (colorsEachProcess+ k);
+                counts[z] = partitionSize(z);
+                displs[z] = partitionStart(z);
             }
         }
-
-        // Gather assignments at the root process
-        MPI_Gatherv(
-            sendbuf, sendcount, MPI_UNSIGNED_CHAR,
-            recvbuf, recvcounts, displs, MPI_UNSIGNED_CHAR,
-            ROOT, MPI_COMM_WORLD
-        );
+        profiler.addBytes(Phase::COLLECT_CLUSTER_ASSIGNMENTS, maxNum * sizeof(int));
+        comm->gatherv(assignment.data(), maxNum, labels.data(), counts.data(), displs.data(), sizeof(int), ROOT);
 
         // Root process consolidates cluster assignments
         if (rank == ROOT) {
-            bufferIndex = 0;
             for (Cluster& cluster : clusters)
                 cluster.elements.clear();
-
-            // Deserialize received assignments
-            for (int z = 0; z < proccesses; z++)
-                for (int i = 0; i < k; i++) {
-                    int size = recvbuf[bufferIndex++];
-                    for (int e = 0; e < size; e++)
-                        clusters[i].elements.push_back(recvbuf[bufferIndex++]);
-                }
-        }
-        // Free allocated memory
-        delete[] sendbuf;
-        if (rank == ROOT) {
-            delete[] recvbuf;
-            delete[] recvcounts;
-            delete[] displs;
+            for (int i = 0; i < nColors; i++)
+                clusters[labels[i]].elements.push_back(i);
         }
     }
 
+    /**
+     * @brief Writes every point's label to labelFile and totals the cluster weights at ROOT.
+     *
+     * Blocks are contiguous in global index order, so each rank's labels go at
+     * element offset partitionStart(rank) and need no index stored with them.
+     * The write and the weight totals are collective.
+     *
+     * @param rank The MPI rank of the current process.
+     * @return true if the file was written; the weights are set either way
+     */
+    bool writeAssignments(int rank) {
+        profiler.addBytes(Phase::COLLECT_CLUSTER_ASSIGNMENTS, maxNum * sizeof(int) + k * sizeof(double));
+        bool written = comm->writeFile(labelFile, assignment.data(), maxNum, partitionStart(rank), nColors, sizeof(int));
+        if (!written && rank == ROOT)
+            KLOG_ERROR("could not write labels to " << labelFile << ", gathering them instead");
+
+        // The coreset's weights stand in for whole regions; these are the full data's
+        labelWeights.assign(2 * k, 0);
+        for (int i = 0; i < maxNum; i++)
+            labelWeights[assignment[i]] += weights[i];
+        comm->allreduce(labelWeights.data(), labelWeights.data() + k, k, Communicator::SUM);
+        if (rank == ROOT)
+            for (int j = 0; j < k; j++) {
+                clusters[j].weight = labelWeights[k + j];
+                clusters[j].elements.clear();
+            }
+        return written;
+    }
+
     /**
      * Get the initial cluster centroids.
      * Default implementation here is to just pick k elements at random from the element
@@ -339,17 +1249,85 @@ protected:
         vector<int> selectedColors;
         vector<int> indices(nColors);
         iota(indices.begin(), indices.end(), 0); // Fill with 0, 1, ..., nColors-1
+        if (nColors == 0)
+            return;
 
         // Correct random number generator usage
         random_device rd;
-        mt19937 rng(rd());
+        mt19937 rng(seed != 0 ? seed : rd());
 
         // Randomly sample k unique elements
-        sample(indices.begin(), indices.end(), back_inserter(selectedColors), k, rd);
+        sample(indices.begin(), indices.end(), back_inserter(selectedColors), k, rng);
 
-        // Assign selected centroids
+        // Assign selected centroids; with fewer points than clusters some start out shared
         for (int i = 0; i < k; i++) {
-            clusters[i].centroid = elements[selectedColors[i]];
+            const unsigned char* selected = elements + (size_t)selectedColors[i % selectedColors.size()] * d;
+            clusters[i].centroid.assign(selected, selected + d);
+            clusters[i].elements.clear();
+        }
+    }
+
+    /**
+     * Pick k points at random from the blocks of fitLocal as the initial centroids.
+     *
+     * Collective. ROOT draws k distinct global indices and broadcasts them in
+     * ascending order. Each rank then sends the chosen points it owns, so ROOT
+     * receives them in that same order without any rank holding the data.
+     *
+     * @param rank The rank of the current process.
+     */
+    virtual void selectLocalClusters(int rank) {
+        vector<int> picks(k);
+        if (rank == ROOT && nColors > 0) {
+            random_device rd;
+            mt19937 rng(seed != 0 ? seed : rd());
+            uniform_int_distribution<int> any(0, nColors - 1);
+            vector<int> drawn;
+            // Distinct while there are enough points; with fewer, some start out shared
+            while ((int)drawn.size() < min(k, nColors)) {
+                int index = any(rng);
+                if (find(drawn.begin(), drawn.end(), index) == drawn.end())
+                    drawn.push_back(index);
+            }
+            for (int i = 0; i < k; i++)
+                picks[i] = drawn[i % drawn.size()];
+            sort(picks.begin(), picks.end());
+        }
+        comm->broadcast(picks.data(), k, sizeof(int), ROOT);
+        if (nColors == 0)
+            return;
+
+        vector<unsigned char> mine, chosen(rank == ROOT ? (size_t)k * d : 0);
+        for (int z = 0; z < proccesses; z++)
+            counts[z] = 0;
+        for (int index : picks) {
+            int owner = upper_bound(bounds.begin(), bounds.end(), index) - bounds.begin() - 1;
+            counts[owner]++;
+            if (owner == rank)
+                mine.insert(mine.end(), partition + (size_t)(index - bounds[rank]) * d,
+                            partition + (size_t)(index - bounds[rank] + 1) * d);
+        }
+        for (int z = 0, at = 0; z < proccesses; z++) {
+            displs[z] = at;
+            at += counts[z];
+        }
+        comm->gatherv(mine.data(), counts[rank], chosen.data(), counts.data(), displs.data(), d, ROOT);
+        if (rank == ROOT)
+            for (int i = 0; i < k; i++) {
+                clusters[i].centroid.assign(&chosen[(size_t)i * d], &chosen[(size_t)(i + 1) * d]);
+                clusters[i].elements.clear();
+            }
+    }
+
+    /**
+     * Use the warm-start model's centroids as the initial centroids.
+     * @pre warmStart matches k and d
+     */
+    virtual void seedClusters() {
+        KLOG_INFO("warm start from a model fitted in " << warmStart.generations << " generations");
+        for (int i = 0; i < k; i++) {
+            const unsigned char* seed = &warmStart.centroids[(size_t)i * d];
+            clusters[i].centroid.assign(seed, seed + d);
             clusters[i].elements.clear();
         }
     }
@@ -363,96 +1341,314 @@ protected:
    * @param rank MPI process rank.
    */
     virtual void distributeCentroids(int rank) {
-        V(cout<<" "<<rank<<" bcastCentroids"<<endl;)
-        int count = k * d;
-        unsigned char* buffer = new unsigned char[count];
-        if (rank == ROOT) {
-            int index = 0;
-            for (int i = 0; i < k; i++)
-                for (int j = 0; j < d; j++)
-                    buffer[index++] = clusters[i].centroid[j];
-            V(cout<<" "<<rank<<" sending centroids ";for(int x=0;x<count;x++)printf("%03x ",buffer[x]);cout<<endl;)
+        KLOG_TRACE("bcastCentroids");
+        // Each cluster's centroid vector is one block, sent and received in place
+        centroidBlocks.resize(k);
+        for (int i = 0; i < k; i++)
+            centroidBlocks[i] = clusters[i].centroid.data();
+        if (rank == ROOT)
+            profiler.addBytes(Phase::DISTRIBUTE_CENTROIDS, k * d);
+        comm->broadcastBlocks(centroidBlocks.data(), k, d, ROOT);
+
+        if constexpr (KMEANS_LOG_LEVEL >= KMEANS_LOG_TRACE) {
+            packCentroids();
+            KLOG_TRACE((rank == ROOT ? "sending" : "receiving") << " centroids " << hexDump(centroidData.data(), k * d));
         }
+    }
+
+    /**
+     * @brief Accumulates the timing of one generation into the before/after buckets.
+     * @param generation Generation number
+     * @param compute Seconds spent on assignment work
+     * @param total Seconds for the whole generation, including collectives
+     */
+    void recordGeneration(int generation, double compute, double total) {
+        int phase = adaptive && generation >= rebalanceGeneration ? 1 : 0;
+        balance.compute[phase] += compute;
+        balance.total[phase] += total;
+        balance.generations[phase]++;
+        balance.points[phase] = maxNum;
+    }
+
+    /**
+     * @brief Moves point ownership so each rank's share matches its measured throughput.
+     *
+     * Throughput (points per second of assignment work) is shared with an allgather and
+     * new contiguous bounds are cut proportionally. Because old and new partitions are both
+     * contiguous, each rank only exchanges the overlap of its old range with every other
+     * rank's new range, in one all-to-all where most counts are zero.
+     *
+     * @param rank MPI rank of the current process.
+     */
+    virtual void rebalancePartitions(int rank) {
+        double throughput = balance.compute[0] > 0 ? balance.generations[0] * maxNum / balance.compute[0] : 0;
+        vector<double> throughputs(proccesses);
+        comm->allgather(&throughput, 1, throughputs.data(), sizeof(double));
+        profiler.addBytes(Phase::REBALANCE_PARTITIONS, sizeof(throughput));
 
-        // Broadcast the centroids from the root process
-        MPI_Bcast(buffer, count, MPI_UNSIGNED_CHAR, ROOT, MPI_COMM_WORLD);
+        // A rank that measured nothing (no points) is assumed to be as fast as the average
+        double sum = 0;
+        int measured = 0;
+        for (double t : throughputs)
+            if (t > 0) {
+                sum += t;
+                measured++;
+            }
+        if (measured == 0)
+            return;
+        for (double& t : throughputs)
+            if (t <= 0)
+                t = sum / measured;
+        sum = 0;
+        for (double t : throughputs)
+            sum += t;
 
-        if (rank != ROOT) {
-            int index = 0;
-            for (int i = 0; i < k; i++)
-                for (int j = 0; j < d; j++)
-                    clusters[i].centroid[j] = buffer[index++];
-            V(cout<<" "<<rank<<" receiving centroids ";for(int x=0;x<count;x++)printf("%03x ",buffer[x]);cout<<endl;)
+        // Cut new bounds from the cumulative throughput share
+        vector<int> newBounds(proccesses + 1);
+        double cumulative = 0;
+        newBounds[0] = 0;
+        for (int z = 0; z < proccesses; z++) {
+            cumulative += throughputs[z];
+            newBounds[z + 1] = (int)(nColors * (cumulative / sum) + 0.5);
+        }
+        newBounds[proccesses] = nColors;
+
+        // Skip the migration when no partition would change noticeably
+        bool worthIt = false;
+        for (int z = 0; z < proccesses; z++) {
+            int oldSize = partitionSize(z), newSize = newBounds[z + 1] - newBounds[z];
+            if (abs(newSize - oldSize) > REBALANCE_THRESHOLD * max(oldSize, 1))
+                worthIt = true;
+        }
+        if (!worthIt)
+            return;
+
+        // Exchange the overlaps of old and new ranges
+        int newStart = newBounds[rank], newSize = newBounds[rank + 1] - newStart;
+        migrationStore.resize((size_t)newSize * d);
+        vector<int> sendCounts(proccesses), sendDispls(proccesses), recvCounts(proccesses), recvDispls(proccesses);
+        double sent = 0;  // points handed to other ranks
+        for (int z = 0; z < proccesses; z++) {
+            // What I own now that z will own
+            int from = max(bounds[rank], newBounds[z]), to = min(bounds[rank + 1], newBounds[z + 1]);
+            sendCounts[z] = max(0, to - from);
+            sendDispls[z] = max(0, from - bounds[rank]);
+            if (z != rank)
+                sent += sendCounts[z];
+            // What z owns now that I will own
+            from = max(bounds[z], newStart);
+            to = min(bounds[z + 1], newStart + newSize);
+            recvCounts[z] = max(0, to - from);
+            recvDispls[z] = max(0, from - newStart);
+        }
+        comm->alltoallv(partition, sendCounts.data(), sendDispls.data(),
+                        migrationStore.data(), recvCounts.data(), recvDispls.data(), d);
+        vector<int> newAssignment(newSize);
+        comm->alltoallv(assignment.data(), sendCounts.data(), sendDispls.data(),
+                        newAssignment.data(), recvCounts.data(), recvDispls.data(), sizeof(int));
+        vector<int> newWeights(newSize, 1);
+        if (weighted) {
+            comm->alltoallv(weights.data(), sendCounts.data(), sendDispls.data(),
+                            newWeights.data(), recvCounts.data(), recvDispls.data(), sizeof(int));
         }
-        delete[] buffer;
+        profiler.addBytes(Phase::REBALANCE_PARTITIONS, sent * (d + sizeof(int) * (weighted ? 2 : 1)));
+
+        // Adopt the new partition
+        partitionStore.swap(migrationStore);
+        partition = partitionStore.data();
+        weights.swap(newWeights);
+        assignment.swap(newAssignment);
+        bounds = newBounds;
+        maxNum = newSize;
+        colorIds.resize(maxNum);
+        iota(colorIds.begin(), colorIds.end(), newStart);
+        resizeAssignments();
+        if (sparse)
+            sparsePartition.build(partition, maxNum, d);
+        if (packed)
+            packedPartition.build(partition, maxNum, d);
     }
 
     /**
-   * @brief Compute the distance between two elements.
-   *
-   * @param first First element.
-   * @param second Second element.
-   * @return The computed distance.
-   */
-    virtual double distance(const Element& first, const Element& second) const = 0;
+     * @brief Prints per-rank generation and idle time before and after rebalancing.
+     *
+     * Idle time is the part of a generation not spent on assignment work, i.e. time in
+     * (or waiting at) the collectives.
+     *
+     * @param rank MPI rank of the current process.
+     */
+    virtual void reportBalance(int rank) {
+        const int FIELDS = 6;
+        double mine[FIELDS];
+        for (int phase = 0; phase < 2; phase++) {
+            int g = max(balance.generations[phase], 1);
+            mine[phase * 3] = balance.points[phase];
+            mine[phase * 3 + 1] = balance.total[phase] / g * 1000;
+            mine[phase * 3 + 2] = (balance.total[phase] - balance.compute[phase]) / g * 1000;
+        }
+        vector<double> all(rank == ROOT ? proccesses * FIELDS : 0);
+        comm->gather(mine, FIELDS, all.data(), sizeof(double), ROOT);
+        if (rank == ROOT) {
+            cout << "\n Partition balance (ms per generation, " << balance.generations[0] << " before / "
+                 << balance.generations[1] << " after rebalancing):\n";
+            cout << " rank\tpoints\tgen\tidle\t| points\tgen\tidle\n";
+            for (int z = 0; z < proccesses; z++) {
+                const double* row = &all[z * FIELDS];
+                cout << " " << z << "\t" << (int)row[0] << "\t" << row[1] << "\t" << row[2]
+                     << "\t| " << (int)row[3] << "\t" << row[4] << "\t" << row[5] << endl;
+            }
+        }
+    }
+
+    /**
+     * @brief Sizes the per-point search state for maxNum points.
+     *
+     * The kd-tree path keeps one label per point instead of the maxNum x k distance
+     * matrix, which would not fit for large k.
+     */
+    void resizeAssignments() {
+        dist.assign(useTree ? 0 : (size_t)maxNum * k, 0.0);
+        nearest.assign(useTree ? maxNum : 0, -1);
+    }
 
     /**
-     * @brief Assigns each element to the nearest cluster and updates centroids.
+     * @brief Decides between dense, sparse and packed distances and builds the copy they need.
+     *
+     * Under AUTO the density is measured over the whole dataset (an allreduce of
+     * nonzero counts), so every rank makes the same choice.
+     */
+    virtual void chooseRepresentation() {
+        double counts[2] = {(double)SparsePoints::countNonzeros(partition, maxNum, d), (double)maxNum * d};
+        double totals[2];
+        comm->allreduce(counts, totals, 2, Communicator::SUM);
+        double density = totals[1] > 0 ? totals[0] / totals[1] : 1.0;
+        sparse = !useTree && d <= SparsePoints::MAX_DIMENSION
+            && (requested == SPARSE || (requested == AUTO && density < sparseDensity(k)));
+        packed = !useTree && requested == PACKED;
+        refining = false;
+        if (sparse)
+            sparsePartition.build(partition, maxNum, d);
+        if (packed)
+            packedPartition.build(partition, maxNum, d);
+        KLOG_INFO("density " << density << ", using " << (useTree ? "kd-tree search" : sparse ? "sparse distances"
+                  : packed ? "packed 4-bit distances" : "dense distances"));
+    }
+
+    /**
+     * @brief Copies the cluster centroids into the contiguous centroidData buffer.
+     */
+    void packCentroids() {
+        for (int j = 0; j < k; j++)
+            copy(clusters[j].centroid.begin(), clusters[j].centroid.end(), centroidData.begin() + (size_t)j * d);
+    }
+
+    /**
+     * @brief Formats bytes as space-separated hex for trace logging.
+     */
+    static string hexDump(const unsigned char* bytes, int count) {
+        ostringstream out;
+        out << hex;
+        for (int x = 0; x < count; x++)
+            out << (x ? " " : "") << (int)bytes[x];
+        return out.str();
+    }
+
+    /**
+     * @brief Assigns each element to the nearest cluster and records what changed.
      *
      * Iterates over all elements and assigns them to the cluster with the smallest distance.
-     * Updates centroids dynamically as new elements are added.
+     * Only points whose cluster changed since the previous generation cost anything
+     * beyond the search: each is subtracted from the weighted sums of its old cluster
+     * and added to those of its new one, in deltaRecords, for combineClusters to
+     * forward to ROOT. The weighted squared distances of the
+     * assignment add up to this rank's inertia.
      */
     virtual void updateClusters() {
-        // Reset cluster elements
-        for (int j = 0; j < k; j++) {
-            clusters[j].centroid = Element{};
-            clusters[j].elements.clear();
-        }
+        const int RECORD = d + 2;
+        // Clear last generation's rows; the others are still zero
+        for (int j = 0; j < k; j++)
+            if (changed[j]) {
+                long long* record = &deltaRecords[(size_t)j * RECORD];
+                fill(record + 1, record + RECORD, 0);
+                changed[j] = 0;
+            }
+        localInertia = 0;
+        moved = 0;
 
         // Assign elements to the closest cluster
         for (int i = 0; i < maxNum; i++) {
             int min = 0;
-            for (int j = 1; j < k; j++)
-                if (dist[i][j] < dist[i][min])
-                    min = j;
-            updateCentroid(clusters[min].centroid, clusters[min].elements.size(), partition[i], 1);
-            clusters[min].elements.push_back(i);
-        }
-    }
+            const unsigned char* point = partition + (size_t)i * d;
+            double distance;
+            if (useTree) {
+                min = nearest[i];
+                distance = squaredDistance(point, &centroidData[(size_t)min * d], d);
+            } else {
+                const double* row = &dist[(size_t)i * k];
+                for (int j = 1; j < k; j++)
+                    if (row[j] < row[min])
+                        min = j;
+                distance = row[min];
+            }
+            long long w = weights[i];
+            localInertia += distance * w;
+            int old = assignment[i];
+            if (min == old)
+                continue;
 
-    /**
-    * @brief Updates a centroid by incorporating newly assigned elements.
-    *
-    * Uses an incremental mean update formula to maintain numerical stability.
-    *
-    * @param centroid The centroid being updated.
-    * @param centroidCount The current number of elements in the cluster.
-    * @param newElement The new element being added to the cluster.
-    * @param newElementCount The count of new elements being added.
-    */
-    virtual void updateCentroid(Element& centroid, int centroidCount, const Element& newElement, int newElementCount) const {
-        int n = centroidCount + newElementCount;
-        for (int i = 0; i < d; i++) {
-            double sum = (double)centroid[i] * centroidCount + (double)newElement[i] * newElementCount;
-            int size = sum / n;
-            centroid[i] = (unsigned char)(size);
+            // Move the point's weight and coordinates from its old cluster to the new one
+            moved++;
+            if (old >= 0) {
+                long long* record = &deltaRecords[(size_t)old * RECORD];
+                record[1] -= w;
+                for (int t = 0; t < d; t++)
+                    record[2 + t] -= w * point[t];
+                changed[old] = 1;
+            }
+            long long* record = &deltaRecords[(size_t)min * RECORD];
+            record[1] += w;
+            for (int t = 0; t < d; t++)
+                record[2 + t] += w * point[t];
+            changed[min] = 1;
+            assignment[i] = min;
         }
+        KLOG_DEBUG(moved << " points changed cluster");
     }
 
     /**
       * @brief Computes the distance between each element and all cluster centroids.
       *
-      * Stores the computed distances in `dist`, where `dist[i][j]` represents
-      * the distance between `partition[i]` and `clusters[j].centroid`.
+      * Stores the computed distances in `dist`, where `dist[i * k + j]` represents
+      * the squared distance between point i of the partition and `clusters[j].centroid`.
+      * With the kd-tree it stores each point's nearest centroid in `nearest` instead,
+      * seeding every search with the point's label from the previous generation.
+      * A PACKED fit reads the 4-bit copy of the points until it starts refining.
       */
     virtual void updateDistances() {
-        for (int i = 0; i < maxNum; i++) {
-            V(cout<<"distances for "<<i<<"(";for(int x=0;x<d;x++)printf("%02x ",partition[i][x]);)
-            for (int j = 0; j < k; j++) {
-                dist[i][j] = distance(clusters[j].centroid, partition[i]);
-                V(cout<<" " << dist[i][j];)
-            }
-            V(cout<<endl;)
+        packCentroids();
+        if (useTree) {
+            copy(assignment.begin(), assignment.end(), nearest.begin());
+            centroidTree.build(centroidData.data(), k, d);
+            centroidTree.assign(partition, maxNum, nearest.data());
+            return;
+        }
+        if (sparse) {
+            centroidNorms.resize(k);
+            for (int j = 0; j < k; j++)
+                centroidNorms[j] = dotProduct(&centroidData[(size_t)j * d], &centroidData[(size_t)j * d], d);
+            SparsePoints::transpose(centroidData.data(), k, d, centroidTransposed);
+            sparsePartition.distances(centroidTransposed.data(), centroidNorms.data(), k, dist.data());
+        } else if (packed && !refining) {
+            packedPartition.distances(centroidData.data(), k, dist.data());
+        } else {
+            kernel(partition, maxNum, centroidData.data(), k, d, dist.data());
         }
+        if constexpr (KMEANS_LOG_LEVEL >= KMEANS_LOG_TRACE)
+            for (int i = 0; i < maxNum; i++) {
+                ostringstream row;
+                for (int j = 0; j < k; j++)
+                    row << " " << dist[(size_t)i * k + j];
+                KLOG_TRACE("distances for " << i << "(" << hexDump(partition + (size_t)i * d, d) << ")" << row.str());
+            }
     }
-};
\ No newline at end of file
+};
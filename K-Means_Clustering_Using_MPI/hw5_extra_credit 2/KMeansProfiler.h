@@ -0,0 +1,253 @@
+/**
+ * @file KMeansProfiler.h
+ * @brief Per-phase timing and communication volume for KMeansMPI runs
+ *
+ * Every rank records, for the setup, for each generation and for the final
+ * collection, how long each phase took and how many payload bytes this rank
+ * handed to MPI. writeReport() gathers all of it at ROOT and writes one JSON
+ * document with per-rank values for every generation.
+ *
+ * With setCounting on, each phase also gathers the hardware counters of the
+ * thread running it (cycles, instructions, cache, branch and dTLB misses; see
+ * PerfCounters.h), kept per rank and read back with totalCounts(). Off, a phase
+ * costs two clock reads and the counters are never opened.
+ */
+#pragma once
+#include <array>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "Communicator.h"
+#include "../../Sum-Convert/PerfCounters.h"
+using namespace std;
+
+/**
+ * @class KMeansProfiler
+ * @brief Records phase times and bytes sent per generation on one rank.
+ */
+class KMeansProfiler {
+public:
+    /// Phases of a fit, named after the KMeansMPI methods that implement them
+    enum Phase {
+        PARTITION_COLORS,
+        REBALANCE_PARTITIONS,
+        UPDATE_DISTANCES,
+        UPDATE_CLUSTERS,
+        COMBINE_CLUSTERS,
+        DISTRIBUTE_CENTROIDS,
+        COLLECT_CLUSTER_ASSIGNMENTS,
+        NUM_PHASES
+    };
+
+    /**
+     * @class Scope
+     * @brief Times a phase from construction to destruction, and counts it if
+     *        the profiler is counting.
+     */
+    class Scope {
+    public:
+        Scope(KMeansProfiler& profiler, Phase phase)
+            : profiler(profiler), phase(phase),
+              counters(profiler.counting ? &PerfCounters::thisThread() : nullptr),
+              startCounts(counters ? counters->read() : PerfCounts()), start(Communicator::wallTime()) {}
+        ~Scope() {
+            profiler.addTime(phase, Communicator::wallTime() - start);
+            if (counters)
+                profiler.addCounts(phase, counters->read() - startCounts);
+        }
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+    private:
+        KMeansProfiler& profiler;
+        Phase phase;
+        PerfCounters* counters;   ///< This thread's counters, or nullptr when not counting
+        PerfCounts startCounts;
+        double start;
+    };
+
+    /**
+     * Forget everything and start a new fit; records go to the setup row until
+     * the first call to beginGeneration.
+     */
+    void reset() {
+        rows.assign(1, Row{});
+        generations = 0;
+    }
+
+    /**
+     * Turn the hardware counters on or off for the phases that follow.
+     */
+    void setCounting(bool on) {
+        counting = on;
+    }
+
+    /**
+     * Make room for this many generations, so that recording them never allocates.
+     */
+    void reserve(int generations) {
+        rows.reserve(generations + 2);  // plus the setup and final rows
+    }
+
+    /**
+     * Start recording a new generation.
+     */
+    void beginGeneration() {
+        rows.emplace_back();
+        generations++;
+    }
+
+    /**
+     * Start recording the final (post-loop) phases.
+     */
+    void beginFinal() {
+        rows.emplace_back();
+    }
+
+    /**
+     * @param phase phase being timed
+     * @param seconds elapsed time to add
+     */
+    void addTime(Phase phase, double seconds) {
+        rows.back().seconds[phase] += seconds;
+    }
+
+    /**
+     * @param phase phase being counted
+     * @param counts hardware counts to add
+     */
+    void addCounts(Phase phase, const PerfCounts& counts) {
+        rows.back().counts[phase] += counts;
+    }
+
+    /**
+     * @param phase phase doing the communication
+     * @param bytes payload bytes this rank passed to MPI as send data
+     */
+    void addBytes(Phase phase, double bytes) {
+        rows.back().bytes[phase] += bytes;
+    }
+
+    /**
+     * @param phase phase of interest
+     * @return seconds this rank spent in the phase since reset, over all rows
+     */
+    double totalSeconds(Phase phase) const {
+        double total = 0;
+        for (const Row& row : rows)
+            total += row.seconds[phase];
+        return total;
+    }
+
+    /**
+     * @param phase phase of interest
+     * @return this rank's hardware counts in the phase since reset, over all rows
+     */
+    PerfCounts totalCounts(Phase phase) const {
+        PerfCounts total;
+        for (const Row& row : rows)
+            total += row.counts[phase];
+        return total;
+    }
+
+    /**
+     * @return number of generations recorded since reset
+     */
+    int getGenerations() const {
+        return generations;
+    }
+
+    /**
+     * Gather every rank's records at root and write them there as JSON.
+     * Collective: every rank must call it, after beginFinal. Generations are
+     * listed per rank, since an asynchronous fit runs a different number on each;
+     * a rank's entries past its own generations are zeros.
+     * @param filename where root writes the report
+     * @param comm ranks taking part
+     * @param root rank that writes the file
+     */
+    void writeReport(const string& filename, Communicator& comm, int root) const {
+        int rank = comm.rank(), processes = comm.size();
+        double nRows = rows.size(), rowsMax;
+        comm.allreduce(&nRows, &rowsMax, 1, Communicator::MAX);
+        int maxRows = rowsMax;
+
+        // Flatten as [row][phase][seconds, bytes]. Ranks that ran fewer generations (in
+        // an asynchronous fit) pad with zeros before their final row, which goes last
+        int count = maxRows * NUM_PHASES * 2;
+        vector<double> mine(count, 0.0), all(rank == root ? count * processes : 0);
+        for (int r = 0; r < (int)rows.size(); r++) {
+            int slot = r == (int)rows.size() - 1 ? maxRows - 1 : r;
+            for (int ph = 0; ph < NUM_PHASES; ph++) {
+                mine[(slot * NUM_PHASES + ph) * 2] = rows[r].seconds[ph];
+                mine[(slot * NUM_PHASES + ph) * 2 + 1] = rows[r].bytes[ph];
+            }
+        }
+        comm.gather(mine.data(), count, all.data(), sizeof(double), root);
+        vector<int> perRank(rank == root ? processes : 0);
+        comm.gather(&generations, 1, perRank.data(), sizeof(int), root);
+        if (rank != root)
+            return;
+
+        ofstream f(filename);
+        f << "{\n  \"ranks\": " << processes << ",\n  \"generations\": [";
+        for (int z = 0; z < processes; z++)
+            f << (z ? ", " : "") << perRank[z];
+        f << "],\n";
+        f << "  \"setup\": ";
+        writeRow(f, all, 0, maxRows, processes);
+        f << ",\n  \"perGeneration\": [";
+        for (int r = 1; r < maxRows - 1; r++) {
+            f << (r > 1 ? "," : "") << "\n    ";
+            writeRow(f, all, r, maxRows, processes);
+        }
+        f << "\n  ],\n  \"final\": ";
+        writeRow(f, all, maxRows - 1, maxRows, processes);
+        f << "\n}\n";
+    }
+
+private:
+    struct Row {
+        array<double, NUM_PHASES> seconds = {};
+        array<double, NUM_PHASES> bytes = {};
+        array<PerfCounts, NUM_PHASES> counts;
+    };
+    vector<Row> rows = vector<Row>(1);
+    int generations = 0;
+    bool counting = false;
+
+    static const char* phaseName(int phase) {
+        static const char* names[NUM_PHASES] = {
+            "partitionColors", "rebalancePartitions", "updateDistances", "updateClusters",
+            "combineClusters", "distributeCentroids", "collectClusterAssignments"
+        };
+        return names[phase];
+    }
+
+    /**
+     * Write one row as {"phase": {"seconds": [per rank], "bytesSent": [per rank]}, ...},
+     * leaving out phases that did nothing on any rank.
+     */
+    static void writeRow(ofstream& f, const vector<double>& all, int row, int maxRows, int processes) {
+        int perRank = maxRows * NUM_PHASES * 2;
+        f << "{";
+        bool first = true;
+        for (int ph = 0; ph < NUM_PHASES; ph++) {
+            bool used = false;
+            for (int z = 0; z < processes; z++) {
+                const double* cell = &all[z * perRank + (row * NUM_PHASES + ph) * 2];
+                used = used || cell[0] > 0 || cell[1] > 0;
+            }
+            if (!used)
+                continue;
+            f << (first ? "" : ", ") << "\"" << phaseName(ph) << "\": {\"seconds\": [";
+            for (int z = 0; z < processes; z++)
+                f << (z ? ", " : "") << all[z * perRank + (row * NUM_PHASES + ph) * 2];
+            f << "], \"bytesSent\": [";
+            for (int z = 0; z < processes; z++)
+                f << (z ? ", " : "") << (long long)all[z * perRank + (row * NUM_PHASES + ph) * 2 + 1];
+            f << "]}";
+            first = false;
+        }
+        f << "}";
+    }
+};
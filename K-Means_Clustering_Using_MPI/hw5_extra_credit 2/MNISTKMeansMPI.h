@@ -10,32 +10,25 @@
 using namespace std;
 /**
  * @class MNIST clustering MPI class using k-means
- * @tparam k the number of clusters for k-means
- * @tparam d the dimensionality of an MNIST image
+ *
+ * Distances use the d = 784 fast-path kernel picked by KMeansMPI, which ranks
+ * centroids exactly like MNISTPixel::calculateEuclideanDistance.
  */
-template<int k, int d>
-class MNISTKMeansMPI : public KMeansMPI<k, d> {
+class MNISTKMeansMPI : public KMeansMPI {
 public:
-    using KMeansMPI<10, 784>::fit;
+    /**
+     * @param k the number of clusters for k-means
+     */
+    explicit MNISTKMeansMPI(int k) : KMeansMPI(k) {}
+
+    using KMeansMPI::fit;
      /**
      * Run k-means clustering on MNIST images
      * @param data pointer to the MNIST data
      * @param num the number of data
      */
-    void fit(MNISTPixel* data, int num) {
-        KMeansMPI<k, d>::fit(reinterpret_cast<array<unsigned char, d>*>(data), num);
-    }
-
-protected:
-    using Element = array<unsigned char, d>;
-     /**
-     * Euclidean distance between MNIST image data
-     * @param x one MNIST data
-     * @param y another MNIST data
-     * @return distance between x and y
-     */
-    double distance(const Element& x, const Element& y) const {
-        return MNISTPixel(x).calculateEuclideanDistance(MNISTPixel(y));
+    void fit(const MNISTPixel* data, int num) {
+        static_assert(sizeof(MNISTPixel) == MNISTPixel::PIXELS_N, "MNISTPixel must be just its pixels");
+        KMeansMPI::fit(reinterpret_cast<const unsigned char*>(data), num, MNISTPixel::getNumPixels());
     }
 };
-
@@ -13,6 +13,10 @@ using namespace std;
 
 MNISTPixel::MNISTPixel(const Pixels pixels) : pixels(pixels) {}
 
+MNISTPixel::MNISTPixel(const unsigned char* data) {
+    copy(data, data + PIXELS_N, pixels.begin());
+}
+
 string MNISTPixel::getPixelHex(int row, int col) const {
     if (row < 0 || row >= ROWS || col < 0 || col >= COLS) {
         cerr << "Error: Index (" << row << ", " << col << ") out of bounds.\n";
@@ -28,6 +28,7 @@ public:
 
     MNISTPixel() {}
     MNISTPixel(Pixels pixels);
+    explicit MNISTPixel(const unsigned char* data);
 
     /**
      * Converts a pixel value to a hexadecimal string.
@@ -45,6 +46,12 @@ public:
      */
     unsigned char getPixelValue(int row, int col) const;
 
+    /**
+     * Direct access to all pixels, row-major.
+     * @return The pixel array.
+     */
+    const Pixels& getPixels() const { return pixels; }
+
     /**
     * Computes the Euclidean distance between two MNIST images.
     * @param other Another MyMNISTPixel instance to compare against.
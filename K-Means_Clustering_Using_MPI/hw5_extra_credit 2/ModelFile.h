@@ -0,0 +1,100 @@
+/**
+ * @file ModelFile.h
+ * @brief Compact binary file holding a fitted k-means model
+ *
+ * Layout (little-endian, as written by the host):
+ *
+ *     "KMMD"  uint32 version  int32 k  int32 d  int32 generations  double inertia
+ *     k x d centroid bytes
+ *     uint32 CRC-32 of everything above
+ *
+ * A 10 x 784 MNIST model is under 8 KiB. load() rejects files whose magic,
+ * version, sizes or checksum do not match, so a truncated or stale file is never
+ * used to seed a fit.
+ */
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+#include "Checksum.h"
+using namespace std;
+
+/**
+ * @struct ModelFile
+ * @brief A model as stored on disk, with save and load.
+ */
+struct ModelFile {
+    static constexpr uint32_t VERSION = 1;
+
+    int k = 0;                          ///< Number of clusters
+    int d = 0;                          ///< Dimensionality
+    int generations = 0;                ///< Generations the fit took
+    double inertia = 0;                 ///< Weighted sum of squared distances to the nearest centroid
+    vector<unsigned char> centroids;    ///< k x d, row-major
+
+    /**
+     * @param filename Path of the file to create
+     * @return true if the whole file was written
+     */
+    bool save(const string& filename) const {
+        vector<unsigned char> bytes;
+        append(bytes, "KMMD", 4);
+        append(bytes, &VERSION, sizeof(VERSION));
+        append(bytes, &k, sizeof(k));
+        append(bytes, &d, sizeof(d));
+        append(bytes, &generations, sizeof(generations));
+        append(bytes, &inertia, sizeof(inertia));
+        append(bytes, centroids.data(), centroids.size());
+        uint32_t checksum = crc32(bytes.data(), bytes.size());
+        append(bytes, &checksum, sizeof(checksum));
+
+        ofstream f(filename, ios::binary);
+        f.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+        return (bool)f;
+    }
+
+    /**
+     * @param filename Path of a file written by save
+     * @return true if the file was read and is intact; on false this is unchanged
+     */
+    bool load(const string& filename) {
+        ifstream f(filename, ios::binary);
+        vector<unsigned char> bytes((istreambuf_iterator<char>(f)), istreambuf_iterator<char>());
+        const size_t HEADER = 4 + sizeof(uint32_t) + 3 * sizeof(int) + sizeof(double);
+        if (bytes.size() < HEADER + sizeof(uint32_t) || memcmp(bytes.data(), "KMMD", 4) != 0)
+            return false;
+
+        ModelFile read;
+        uint32_t version, checksum;
+        size_t at = 4;
+        extract(bytes, at, &version, sizeof(version));
+        extract(bytes, at, &read.k, sizeof(read.k));
+        extract(bytes, at, &read.d, sizeof(read.d));
+        extract(bytes, at, &read.generations, sizeof(read.generations));
+        extract(bytes, at, &read.inertia, sizeof(read.inertia));
+        if (version != VERSION || read.k <= 0 || read.d <= 0
+            || bytes.size() != HEADER + (size_t)read.k * read.d + sizeof(checksum))
+            return false;
+        read.centroids.resize((size_t)read.k * read.d);
+        extract(bytes, at, read.centroids.data(), read.centroids.size());
+        extract(bytes, at, &checksum, sizeof(checksum));
+        if (checksum != crc32(bytes.data(), bytes.size() - sizeof(checksum)))
+            return false;
+        *this = move(read);
+        return true;
+    }
+
+private:
+    static void append(vector<unsigned char>& bytes, const void* data, size_t n) {
+        const unsigned char* p = static_cast<const unsigned char*>(data);
+        bytes.insert(bytes.end(), p, p + n);
+    }
+
+    static void extract(const vector<unsigned char>& bytes, size_t& at, void* data, size_t n) {
+        memcpy(data, bytes.data() + at, n);
+        at += n;
+    }
+};
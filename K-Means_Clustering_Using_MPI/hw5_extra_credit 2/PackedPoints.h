@@ -0,0 +1,113 @@
+/**
+ * @file PackedPoints.h
+ * @brief 4-bit quantized points, two values per byte, and a distance kernel over them
+ *
+ * Once distances are vectorized, the assignment pass over MNIST is bound by
+ * memory bandwidth: every generation streams all n x 784 bytes of the partition.
+ * Quantized to 16 levels and packed two per byte, each point streams half as
+ * many bytes.
+ *
+ * A value x is stored as q = round(x / 17), which decodes to 17 q. The 16 levels
+ * 0, 17, ..., 255 keep 0 and 255 exact, so the MNIST background and full strokes
+ * do not move, and no value moves by more than 8.
+ *
+ * With |x|^2 of each decoded point stored at build time and |c|^2 per centroid,
+ *
+ *     |x - c|^2 = |x|^2 + |c|^2 - 2 * 17 * (q . c)
+ *
+ * so only the levels q are needed, never the decoded values. Each point's bytes
+ * are split once into its low nibbles (even values) then its high nibbles (odd
+ * values), as 16-bit lanes; the mask-and-shift loop vectorizes into SIMD nibble
+ * unpacking. The centroids are laid out the same way once per pass, so q . c for
+ * every centroid is a 16-bit multiply-add loop (pmaddwd) over the unpacked point,
+ * which stays in L1. The centroids keep full precision and the arithmetic is
+ * exact, so only the points are approximate.
+ */
+#pragma once
+#include <vector>
+using namespace std;
+
+/**
+ * @class PackedPoints
+ * @brief A block of points quantized to 4 bits per value.
+ */
+class PackedPoints {
+public:
+    /// Decoded value of a stored level q is q * STEP
+    static const int STEP = 17;
+
+    /**
+     * Quantize and pack dense points.
+     * @param points n row-major points of d values each
+     * @param n number of points
+     * @param d dimensionality
+     */
+    void build(const unsigned char* points, int n, int d) {
+        this->n = n;
+        this->d = d;
+        stride = (d + 1) / 2;
+        packed.assign((size_t)n * stride, 0);
+        squaredNorms.assign(n, 0);
+        for (int i = 0; i < n; i++) {
+            const unsigned char* point = points + (size_t)i * d;
+            unsigned char* row = &packed[(size_t)i * stride];
+            for (int t = 0; t < d; t++) {
+                unsigned char q = (point[t] + STEP / 2) / STEP;
+                row[t / 2] |= t % 2 == 0 ? q : q << 4;
+                squaredNorms[i] += (long long)q * q * STEP * STEP;
+            }
+        }
+    }
+
+    /**
+     * dist[i * k + j] = |decoded point i - centroid j|^2
+     * @param centroids k row-major centroids of d values each
+     * @param k number of centroids
+     * @param dist output, n x k squared distances
+     */
+    void distances(const unsigned char* centroids, int k, double* dist) {
+        // Each centroid as its even values then its odd ones, facing the nibbles
+        const int width = 2 * stride;
+        split.assign((size_t)k * width, 0);
+        norms.assign(k, 0);
+        for (int j = 0; j < k; j++)
+            for (int t = 0; t < d; t++) {
+                unsigned char c = centroids[(size_t)j * d + t];
+                split[(size_t)j * width + (t % 2) * stride + t / 2] = c;
+                norms[j] += (long long)c * c;
+            }
+
+        levels.resize(width);
+        for (int i = 0; i < n; i++) {
+            const unsigned char* row = &packed[(size_t)i * stride];
+            for (int b = 0; b < stride; b++) {
+                levels[b] = row[b] & 15;
+                levels[stride + b] = row[b] >> 4;
+            }
+            for (int j = 0; j < k; j++) {
+                int dot = dotLevels(levels.data(), &split[(size_t)j * width], width);
+                dist[(size_t)i * k + j] = squaredNorms[i] + norms[j] - 2LL * STEP * dot;
+            }
+        }
+    }
+
+private:
+    int n = 0;
+    int d = 0;
+    int stride = 0;                  ///< Bytes per packed point
+    vector<unsigned char> packed;    ///< n x stride, value 2t in the low nibble of byte t
+    vector<long long> squaredNorms;  ///< |decoded x|^2 of each point
+    vector<short> split;             ///< Each centroid's even then odd values (k x 2 stride)
+    vector<long long> norms;         ///< |c|^2 of each centroid
+    vector<short> levels;            ///< The current point's low then high nibbles
+
+    /**
+     * q . c over 16-bit lanes (exact while width < 2^19).
+     */
+    static int dotLevels(const short* levels, const short* centroid, int width) {
+        int sum = 0;
+        for (int t = 0; t < width; t++)
+            sum += levels[t] * centroid[t];
+        return sum;
+    }
+};
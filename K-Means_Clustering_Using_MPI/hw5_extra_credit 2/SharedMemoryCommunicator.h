@@ -0,0 +1,272 @@
+/**
+ * @file SharedMemoryCommunicator.h
+ * @brief In-process Communicator where the ranks are threads
+ *
+ * Collectives are pointer exchanges: each rank publishes the address of its send
+ * buffer in a shared slot, a barrier makes the slots visible, and every receiver
+ * copies straight from the sender's buffer into its own. There is no
+ * serialization into intermediate buffers and no transport layer; a second barrier
+ * keeps the send buffers alive until every receiver is done with them.
+ *
+ * Windows are plain vectors. Once their addresses are exchanged, accumulate and
+ * fetch work on them directly with atomic_ref.
+ *
+ * writeFile has rank 0 create the file at its full size, then every rank
+ * pwrites its own piece.
+ */
+#pragma once
+#include <atomic>
+#include <barrier>
+#include <cstring>
+#include <fcntl.h>
+#include <functional>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+#include "Communicator.h"
+#include "KMeansLog.h"
+using namespace std;
+
+class SharedMemoryCommunicator;
+
+/**
+ * @class SharedMemoryGroup
+ * @brief State shared by the threads acting as ranks.
+ */
+class SharedMemoryGroup {
+public:
+    explicit SharedMemoryGroup(int size)
+        : size(size), sync(size), data(size), counts(size), displs(size) {}
+
+    /**
+     * Run work on size threads, passing each its communicator, and wait for all of them.
+     * @param size number of ranks (threads)
+     * @param work called once per rank
+     */
+    static void run(int size, const function<void(SharedMemoryCommunicator&)>& work);
+
+private:
+    friend class SharedMemoryCommunicator;
+    int size;
+    barrier<> sync;
+    vector<const void*> data;    ///< Published buffer per rank
+    vector<const int*> counts;   ///< Published counts (or indices) per rank
+    vector<const int*> displs;   ///< Published displacements per rank
+};
+
+/**
+ * @class SharedMemoryCommunicator
+ * @brief One thread's view of a SharedMemoryGroup.
+ */
+class SharedMemoryCommunicator : public Communicator {
+public:
+    SharedMemoryCommunicator(SharedMemoryGroup& group, int rank) : group(group), me(rank) {}
+
+    int rank() const override {
+        return me;
+    }
+
+    int size() const override {
+        return group.size;
+    }
+
+    void broadcast(void* data, int count, int elemSize, int root) override {
+        if (me == root)
+            group.data[root] = data;
+        wait();
+        if (me != root)
+            memcpy(data, group.data[root], (size_t)count * elemSize);
+        wait();
+    }
+
+    void scatterv(const void* send, const int* counts, const int* displs,
+                  void* recv, int recvCount, int elemSize, int root) override {
+        if (me == root)
+            publish(root, send, counts, displs);
+        wait();
+        const char* src = static_cast<const char*>(group.data[root]);
+        memcpy(recv, src + (size_t)group.displs[root][me] * elemSize, (size_t)recvCount * elemSize);
+        wait();
+    }
+
+    void gather(const void* send, int count, void* recv, int elemSize, int root) override {
+        group.data[me] = send;
+        wait();
+        if (me == root)
+            for (int z = 0; z < group.size; z++)
+                memcpy(static_cast<char*>(recv) + (size_t)z * count * elemSize, group.data[z],
+                       (size_t)count * elemSize);
+        wait();
+    }
+
+    void gatherv(const void* send, int, void* recv,
+                 const int* counts, const int* displs, int elemSize, int root) override {
+        group.data[me] = send;
+        wait();
+        if (me == root)
+            for (int z = 0; z < group.size; z++)
+                memcpy(static_cast<char*>(recv) + (size_t)displs[z] * elemSize, group.data[z],
+                       (size_t)counts[z] * elemSize);
+        wait();
+    }
+
+    void broadcastBlocks(void* const* blocks, int blockCount, int elemSize, int root) override {
+        if (me == root)
+            group.data[root] = blocks;
+        wait();
+        if (me != root) {
+            void* const* source = static_cast<void* const*>(group.data[root]);
+            for (int b = 0; b < blockCount; b++)
+                memcpy(blocks[b], source[b], elemSize);
+        }
+        wait();
+    }
+
+    void gathervIndexed(const void* send, const int* indices, int, void* recv,
+                        const int* counts, const int* displs, int elemSize, int root) override {
+        publish(me, send, indices, nullptr);
+        wait();
+        if (me == root)
+            for (int z = 0; z < group.size; z++) {
+                const char* src = static_cast<const char*>(group.data[z]);
+                char* dst = static_cast<char*>(recv) + (size_t)displs[z] * elemSize;
+                for (int b = 0; b < counts[z]; b++)
+                    memcpy(dst + (size_t)b * elemSize, src + (size_t)group.counts[z][b] * elemSize, elemSize);
+            }
+        wait();
+    }
+
+    void allgather(const void* send, int count, void* recv, int elemSize) override {
+        group.data[me] = send;
+        wait();
+        for (int z = 0; z < group.size; z++)
+            memcpy(static_cast<char*>(recv) + (size_t)z * count * elemSize, group.data[z],
+                   (size_t)count * elemSize);
+        wait();
+    }
+
+    void alltoallv(const void* send, const int* sendCounts, const int* sendDispls,
+                   void* recv, const int* recvCounts, const int* recvDispls, int elemSize) override {
+        publish(me, send, sendCounts, sendDispls);
+        wait();
+        for (int z = 0; z < group.size; z++) {
+            const char* src = static_cast<const char*>(group.data[z]) + (size_t)group.displs[z][me] * elemSize;
+            memcpy(static_cast<char*>(recv) + (size_t)recvDispls[z] * elemSize, src,
+                   (size_t)recvCounts[z] * elemSize);
+        }
+        wait();
+    }
+
+    void allreduce(const double* send, double* recv, int count, ReduceOp op) override {
+        group.data[me] = send;
+        wait();
+        for (int i = 0; i < count; i++) {
+            double result = static_cast<const double*>(group.data[0])[i];
+            for (int z = 1; z < group.size; z++) {
+                double value = static_cast<const double*>(group.data[z])[i];
+                result = op == SUM ? result + value : op == MAX ? max(result, value) : min(result, value);
+            }
+            recv[i] = result;
+        }
+        wait();
+    }
+
+    void barrier() override {
+        wait();
+    }
+
+    long long* openWindow(int count) override {
+        window.assign(count, 0);
+        group.data[me] = window.data();
+        wait();
+        windows.resize(group.size);
+        for (int z = 0; z < group.size; z++)
+            windows[z] = static_cast<long long*>(const_cast<void*>(group.data[z]));
+        wait();
+        return window.data();
+    }
+
+    void accumulate(const long long* data, int count, int target, int offset) override {
+        long long* base = windows[target] + offset;
+        for (int i = 0; i < count; i++)
+            atomic_ref<long long>(base[i]).fetch_add(data[i], memory_order_release);
+    }
+
+    void fetch(long long* data, int count, int target, int offset) override {
+        long long* base = windows[target] + offset;
+        for (int i = 0; i < count; i++)
+            data[i] = atomic_ref<long long>(base[i]).load(memory_order_acquire);
+    }
+
+    void flush(int) override {
+        atomic_thread_fence(memory_order_seq_cst);
+    }
+
+    void closeWindow() override {
+        wait();  // nobody touches a window once its owner may free it
+        windows.clear();
+    }
+
+    bool writeFile(const string& path, const void* data, int count,
+                   long long offset, long long totalCount, int elemSize) override {
+        double ok = 1;
+        if (me == 0) {
+            int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            ok = fd >= 0 && ftruncate(fd, (off_t)totalCount * elemSize) == 0;
+            if (fd >= 0)
+                close(fd);
+        }
+        double created;
+        allreduce(&ok, &created, 1, MIN);
+        ok = 0;
+        if (created) {
+            int fd = ::open(path.c_str(), O_WRONLY);
+            const char* bytes = static_cast<const char*>(data);
+            size_t left = (size_t)count * elemSize;
+            off_t at = (off_t)offset * elemSize;
+            while (fd >= 0 && left > 0) {
+                ssize_t written = pwrite(fd, bytes, left, at);
+                if (written <= 0)
+                    break;
+                bytes += written;
+                left -= written;
+                at += written;
+            }
+            ok = fd >= 0 && left == 0;
+            if (fd >= 0)
+                close(fd);
+        }
+        double all;
+        allreduce(&ok, &all, 1, MIN);
+        return all != 0;
+    }
+
+private:
+    SharedMemoryGroup& group;
+    int me;
+    vector<long long> window;      ///< This rank's window memory
+    vector<long long*> windows;    ///< Every rank's window, while one is open
+
+    void wait() {
+        group.sync.arrive_and_wait();
+    }
+
+    void publish(int z, const void* data, const int* counts, const int* displs) {
+        group.data[z] = data;
+        group.counts[z] = counts;
+        group.displs[z] = displs;
+    }
+};
+
+inline void SharedMemoryGroup::run(int size, const function<void(SharedMemoryCommunicator&)>& work) {
+    SharedMemoryGroup group(size);
+    vector<thread> ranks;
+    for (int z = 0; z < size; z++)
+        ranks.emplace_back([&group, &work, z] {
+            kmeansLogRank = z;
+            SharedMemoryCommunicator comm(group, z);
+            work(comm);
+        });
+    for (thread& t : ranks)
+        t.join();
+}
@@ -0,0 +1,118 @@
+/**
+ * @file alloc_benchmark.cpp
+ * @brief Counts heap allocations and tracks resident memory over many KMeansMPI fits.
+ *
+ *     mpirun -n P ./alloc_benchmark [fits] [n] [d] [k]
+ *
+ * One KMeansMPI object fits the same synthetic blobs over and over, as a
+ * long-running service would. Every tenth of the run, ROOT reports the heap
+ * allocations per fit and per generation since the last report, and the
+ * resident set size. A steady state should show a flat RSS, and an allocation
+ * count per fit that does not grow with the number of generations.
+ */
+
+#include <atomic>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <random>
+#include <string>
+#include <unistd.h>
+#include <vector>
+#include "KMeansMPI.h"
+#include "mpi.h"
+
+using namespace std;
+
+const int ROOT = 0;
+
+/// Calls to operator new in this process
+atomic<long long> allocations{0};
+
+// The replacements pair malloc with free, which GCC cannot see through once inlined
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+
+void* operator new(size_t size) {
+    allocations.fetch_add(1, memory_order_relaxed);
+    if (void* p = malloc(size ? size : 1))
+        return p;
+    throw bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    free(p);
+}
+#pragma GCC diagnostic pop
+
+/**
+ * @return resident set size of this process in KiB, from /proc/self/statm
+ */
+long residentKiB() {
+    long pages = 0, resident = 0;
+    ifstream statm("/proc/self/statm");
+    statm >> pages >> resident;
+    return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+/**
+ * Makes n points of dimension d scattered around k random centers.
+ */
+vector<unsigned char> makeBlobs(int n, int d, int k, unsigned seed) {
+    mt19937 rng(seed);
+    uniform_int_distribution<int> centerDist(20, 235), noise(-20, 20), pick(0, k - 1);
+    vector<unsigned char> centers((size_t)k * d), points((size_t)n * d);
+    for (auto& c : centers)
+        c = centerDist(rng);
+    for (int i = 0; i < n; i++) {
+        int c = pick(rng);
+        for (int j = 0; j < d; j++)
+            points[(size_t)i * d + j] = centers[(size_t)c * d + j] + noise(rng);
+    }
+    return points;
+}
+
+int main(int argc, char* argv[]) {
+    MPI_Init(&argc, &argv);
+    int rank, processes;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &processes);
+    int fits = argc > 1 ? stoi(argv[1]) : 200;
+    int n = argc > 2 ? stoi(argv[2]) : 20000;
+    int d = argc > 3 ? stoi(argv[3]) : 16;
+    int k = argc > 4 ? stoi(argv[4]) : 16;
+
+    vector<unsigned char> points;
+    if (rank == ROOT)
+        points = makeBlobs(n, d, k, 3);
+    KMeansMPI kMeans(k);
+    int every = max(1, fits / 10), generations = 0;
+    long long counted = allocations.load();
+    for (int fit = 1; fit <= fits; fit++) {
+        if (rank == ROOT)
+            kMeans.fit(points.data(), n, d);
+        else
+            kMeans.fitWork(rank);
+        generations += kMeans.getGenerations();
+        if (fit % every == 0 || fit == fits) {
+            long long now = allocations.load();
+            double perFit = (double)(now - counted) / every, perGeneration = (double)(now - counted) / max(generations, 1);
+            double stats[3] = {perFit, perGeneration, (double)residentKiB()}, worst[3];
+            MPI_Reduce(stats, worst, 3, MPI_DOUBLE, MPI_MAX, ROOT, MPI_COMM_WORLD);
+            if (rank == ROOT)
+                cout << "fits=" << fit << " allocations_per_fit=" << worst[0]
+                     << " allocations_per_generation=" << worst[1]
+                     << " rss_kib=" << (long)worst[2] << endl;
+            counted = allocations.load();
+            generations = 0;
+        }
+    }
+
+    MPI_Finalize();
+    return 0;
+}
@@ -0,0 +1,105 @@
+/**
+ * @file async_benchmark.cpp
+ * @brief Compares lockstep and asynchronous KMeansMPI fits when one rank is slow.
+ *
+ *     mpirun -n P ./async_benchmark [n] [d] [k] [delay_ms] [moved_fraction]
+ *
+ * The last rank sleeps delay_ms after computing its distances in every pass,
+ * standing in for a slower node or a noisy neighbour. The same data and initial
+ * centroids are fitted in lockstep and then with setAsynchronous at a few
+ * staleness bounds. Every fit stops at the same moved_fraction tolerance (0 by
+ * default: when no point moves). For each fit the report gives wall time, the
+ * passes made by ROOT and by the slow rank, and the final inertia.
+ */
+
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include "KMeansMPI.h"
+#include "mpi.h"
+
+using namespace std;
+
+const int ROOT = 0;
+
+/**
+ * @class SlowedKMeans
+ * @brief KMeansMPI that sleeps after every distance pass on one rank.
+ */
+class SlowedKMeans : public KMeansMPI {
+public:
+    SlowedKMeans(int k, bool slow, int delayMs) : KMeansMPI(k), slow(slow), delayMs(delayMs) {}
+
+protected:
+    void updateDistances() override {
+        KMeansMPI::updateDistances();
+        if (slow)
+            this_thread::sleep_for(chrono::milliseconds(delayMs));
+    }
+
+private:
+    bool slow;
+    int delayMs;
+};
+
+/**
+ * Makes n points of dimension d scattered around k random centers.
+ */
+vector<unsigned char> makeBlobs(int n, int d, int k, unsigned seed) {
+    mt19937 rng(seed);
+    uniform_int_distribution<int> centerDist(20, 235), noise(-20, 20), pick(0, k - 1);
+    vector<unsigned char> centers((size_t)k * d), points((size_t)n * d);
+    for (auto& c : centers)
+        c = centerDist(rng);
+    for (int i = 0; i < n; i++) {
+        int c = pick(rng);
+        for (int j = 0; j < d; j++)
+            points[(size_t)i * d + j] = centers[(size_t)c * d + j] + noise(rng);
+    }
+    return points;
+}
+
+int main(int argc, char* argv[]) {
+    MPI_Init(&argc, &argv);
+    int rank, processes;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &processes);
+    int n = argc > 1 ? stoi(argv[1]) : 100000;
+    int d = argc > 2 ? stoi(argv[2]) : 16;
+    int k = argc > 3 ? stoi(argv[3]) : 32;
+    int delayMs = argc > 4 ? stoi(argv[4]) : 20;
+    KMeansMPI::Tolerances tolerances;
+    tolerances.movedFraction = argc > 5 ? stod(argv[5]) : 0;
+
+    vector<unsigned char> points;
+    if (rank == ROOT)
+        points = makeBlobs(n, d, k, 11);
+    bool slow = processes > 1 && rank == processes - 1;
+
+    for (int staleness : {0, 1, 2, 4, 8}) {
+        SlowedKMeans kMeans(k, slow, delayMs);
+        kMeans.setSeed(5);
+        kMeans.setAsynchronous(staleness);
+        kMeans.setTolerances(tolerances);
+        MPI_Barrier(MPI_COMM_WORLD);
+        double start = MPI_Wtime();
+        if (rank == ROOT)
+            kMeans.fit(points.data(), n, d);
+        else
+            kMeans.fitWork(rank);
+        double seconds = MPI_Wtime() - start;
+
+        int passes[2] = {kMeans.getGenerations(), slow ? kMeans.getGenerations() : 0}, most[2];
+        MPI_Reduce(passes, most, 2, MPI_INT, MPI_MAX, ROOT, MPI_COMM_WORLD);
+        if (rank == ROOT)
+            cout << (staleness == 0 ? "lockstep" : "async") << " ranks=" << processes << " staleness=" << staleness
+                 << " delay_ms=" << delayMs << " moved_fraction=" << tolerances.movedFraction << " fit_ms=" << seconds * 1000 << " root_passes=" << most[0]
+                 << " slow_rank_passes=" << most[1] << " inertia=" << kMeans.getInertia() << endl;
+    }
+
+    MPI_Finalize();
+    return 0;
+}
@@ -0,0 +1,101 @@
+/**
+ * @file bisect_benchmark.cpp
+ * @brief Compares bisecting k-means with flat KMeansMPI on the same data.
+ *
+ *     mpirun -n P ./bisect_benchmark [n] [d] [k] [flat]
+ *
+ * Data is n points of dimension d around k random centers. Both fits report
+ * wall time and inertia. For bisecting k-means the report also gives how often
+ * the O(log k) tree descent (predictTree) finds the same leaf as the exact
+ * nearest-centroid search (predict), and the speed of each. Pass flat = 0 to
+ * skip the flat fit when k is too large for it.
+ */
+
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include "BisectingKMeans.h"
+#include "mpi.h"
+
+using namespace std;
+
+const int ROOT = 0;
+
+/**
+ * Makes n points of dimension d scattered around k random centers.
+ */
+vector<unsigned char> makeBlobs(int n, int d, int k, unsigned seed) {
+    mt19937 rng(seed);
+    uniform_int_distribution<int> centerDist(20, 235), noise(-20, 20), pick(0, k - 1);
+    vector<unsigned char> centers((size_t)k * d), points((size_t)n * d);
+    for (auto& c : centers)
+        c = centerDist(rng);
+    for (int i = 0; i < n; i++) {
+        int c = pick(rng);
+        for (int j = 0; j < d; j++)
+            points[(size_t)i * d + j] = centers[(size_t)c * d + j] + noise(rng);
+    }
+    return points;
+}
+
+/**
+ * Fits kMeans on every rank; at ROOT returns the wall time in seconds.
+ */
+double timeFit(KMeansMPI& kMeans, int rank, const vector<unsigned char>& points, int n, int d) {
+    MPI_Barrier(MPI_COMM_WORLD);
+    auto start = chrono::steady_clock::now();
+    if (rank == ROOT)
+        kMeans.fit(points.data(), n, d);
+    else
+        kMeans.fitWork(rank);
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char* argv[]) {
+    MPI_Init(&argc, &argv);
+    int rank, processes;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &processes);
+    int n = argc > 1 ? stoi(argv[1]) : 100000;
+    int d = argc > 2 ? stoi(argv[2]) : 16;
+    int k = argc > 3 ? stoi(argv[3]) : 512;
+    bool flat = argc > 4 ? stoi(argv[4]) != 0 : true;
+
+    vector<unsigned char> points;
+    if (rank == ROOT)
+        points = makeBlobs(n, d, k, 17);
+
+    BisectingKMeans bisecting(k);
+    double bisectSeconds = timeFit(bisecting, rank, points, n, d);
+    double flatSeconds = 0;
+    KMeansMPI flatKMeans(k);
+    if (flat)
+        flatSeconds = timeFit(flatKMeans, rank, points, n, d);
+
+    if (rank == ROOT) {
+        vector<int> exact(n), descended(n);
+        auto start = chrono::steady_clock::now();
+        bisecting.predict(points.data(), n, exact.data());
+        auto predicted = chrono::steady_clock::now();
+        bisecting.predictTree(points.data(), n, descended.data());
+        auto walked = chrono::steady_clock::now();
+        int agree = 0;
+        for (int i = 0; i < n; i++)
+            agree += exact[i] == descended[i];
+
+        cout << "ranks=" << processes << " n=" << n << " d=" << d << " k=" << k << endl;
+        cout << "bisecting leaves=" << bisecting.getK() << " rounds=" << bisecting.getGenerations()
+             << " fit_ms=" << bisectSeconds * 1000 << " inertia=" << bisecting.getInertia() << endl;
+        if (flat)
+            cout << "flat generations=" << flatKMeans.getGenerations()
+                 << " fit_ms=" << flatSeconds * 1000 << " inertia=" << flatKMeans.getInertia() << endl;
+        cout << "predict_ms=" << chrono::duration<double>(predicted - start).count() * 1000
+             << " predict_tree_ms=" << chrono::duration<double>(walked - predicted).count() * 1000
+             << " tree_agreement=" << (double)agree / n << endl;
+    }
+
+    MPI_Finalize();
+    return 0;
+}
@@ -0,0 +1,116 @@
+/**
+ * @file comm_benchmark.cpp
+ * @brief Compares the MPI and shared-memory communication backends of KMeansMPI.
+ *
+ * The same fitWork runs either as MPI processes or as threads of this process:
+ *
+ *     mpirun -n P ./comm_benchmark mpi [n] [d] [k]
+ *     ./comm_benchmark threads P [n] [d] [k]
+ *
+ * Data is a synthetic set of k noisy blobs, and both backends start from the
+ * same seeded centroids, so they run the same fit. The report gives time per
+ * generation and how much of it the slowest rank spent in the collectives.
+ */
+
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include "KMeansMPI.h"
+#include "SharedMemoryCommunicator.h"
+#include "mpi.h"
+
+using namespace std;
+
+const int ROOT = 0;
+const unsigned SEED = 7;  ///< Initial centroids, the same for both backends
+
+/**
+ * Makes n points of dimension d scattered around k random centers.
+ */
+vector<unsigned char> makeBlobs(int n, int d, int k, unsigned seed) {
+    mt19937 rng(seed);
+    uniform_int_distribution<int> centerDist(20, 235), noise(-20, 20), pick(0, k - 1);
+    vector<unsigned char> centers((size_t)k * d), points((size_t)n * d);
+    for (auto& c : centers)
+        c = centerDist(rng);
+    for (int i = 0; i < n; i++) {
+        int c = pick(rng);
+        for (int j = 0; j < d; j++)
+            points[(size_t)i * d + j] = centers[(size_t)c * d + j] + noise(rng);
+    }
+    return points;
+}
+
+/**
+ * Runs one rank's share of a fit and returns its collective time.
+ */
+double runRank(KMeansMPI& kMeans, Communicator& comm, const vector<unsigned char>& points, int n, int d) {
+    if (comm.rank() == ROOT)
+        kMeans.fit(points.data(), n, d);
+    else
+        kMeans.fitWork(comm.rank());
+    const KMeansProfiler& profiler = kMeans.getProfiler();
+    return profiler.totalSeconds(KMeansProfiler::PARTITION_COLORS)
+         + profiler.totalSeconds(KMeansProfiler::COMBINE_CLUSTERS)
+         + profiler.totalSeconds(KMeansProfiler::DISTRIBUTE_CENTROIDS)
+         + profiler.totalSeconds(KMeansProfiler::COLLECT_CLUSTER_ASSIGNMENTS);
+}
+
+void report(const string& backend, int ranks, int generations, double seconds, double commSeconds) {
+    int g = max(generations, 1);
+    cout << backend << " ranks=" << ranks << " generations=" << generations
+         << " total_ms=" << seconds * 1000
+         << " ms_per_generation=" << seconds * 1000 / g
+         << " collective_ms_per_generation=" << commSeconds * 1000 / g << endl;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2 || (string(argv[1]) != "mpi" && string(argv[1]) != "threads")) {
+        cerr << "usage: mpirun -n P " << argv[0] << " mpi [n] [d] [k]\n"
+             << "       " << argv[0] << " threads P [n] [d] [k]\n";
+        return 1;
+    }
+    bool threads = string(argv[1]) == "threads";
+    int arg = threads ? 3 : 2;
+    int ranks = threads && argc > 2 ? stoi(argv[2]) : 1;
+    int n = argc > arg ? stoi(argv[arg]) : 100000;
+    int d = argc > arg + 1 ? stoi(argv[arg + 1]) : 3;
+    int k = argc > arg + 2 ? stoi(argv[arg + 2]) : 16;
+
+    if (threads) {
+        vector<unsigned char> points = makeBlobs(n, d, k, 1);
+        vector<double> commSeconds(ranks);
+        int generations = 0;
+        double start = Communicator::wallTime();
+        SharedMemoryGroup::run(ranks, [&](SharedMemoryCommunicator& comm) {
+            KMeansMPI kMeans(k);
+            kMeans.setCommunicator(comm);
+            kMeans.setSeed(SEED);
+            commSeconds[comm.rank()] = runRank(kMeans, comm, points, n, d);
+            if (comm.rank() == ROOT)
+                generations = kMeans.getProfiler().getGenerations();
+        });
+        double seconds = Communicator::wallTime() - start;
+        report("threads", ranks, generations, seconds, *max_element(commSeconds.begin(), commSeconds.end()));
+        return 0;
+    }
+
+    MPI_Init(nullptr, nullptr);
+    MPICommunicator comm;
+    ranks = comm.size();
+    vector<unsigned char> points;
+    if (comm.rank() == ROOT)
+        points = makeBlobs(n, d, k, 1);
+    KMeansMPI kMeans(k);
+    kMeans.setSeed(SEED);
+    comm.barrier();
+    double start = Communicator::wallTime();
+    double mine = runRank(kMeans, comm, points, n, d), slowest;
+    double seconds = Communicator::wallTime() - start;
+    comm.allreduce(&mine, &slowest, 1, Communicator::MAX);
+    if (comm.rank() == ROOT)
+        report("mpi", ranks, kMeans.getProfiler().getGenerations(), seconds, slowest);
+    MPI_Finalize();
+    return 0;
+}
@@ -23,7 +23,9 @@
 #include <string>
 #include <array>
 #include <random>
+#include <vector>
 #include "MNISTKMeansMPI.h"
+#include "ClusterAtlas.h"
 #include "mpi.h"
 
 using namespace std;
@@ -34,6 +36,7 @@ const int ROOT = 0;
 
 const string MNIST_IMAGES_FILEPATH = "./images-idx3-ubyte";
 const string MNIST_LABELS_FILEPATH = "./labels-idx1-ubyte";
+const string MODEL_FILEPATH = "./kmeans_mnist_mpi.model";
 
 /**
  * Reads and loads MNIST image data from a binary file.
@@ -57,50 +60,56 @@ void loadMNISTLabels(unsigned char**, int*);
 uint32_t swapEndian(uint32_t);
 
 /**
- * Displays the k-means clustering results, showing MNIST labels grouped by clusters.
+ * Serves the loaded images back through predict in small batches, checks the labels
+ * against the fitted assignments and prints latency percentiles and throughput.
+ * @param kMeans The fitted model.
  * @param clusters The final clusters after convergence.
- * @param labels Pointer to the MNIST label data.
+ * @param images Pointer to the MNIST image data.
+ * @param n Number of images.
  */
-void displayClusters(
-    const MNISTKMeansMPI<K, MNISTPixel::getNumPixels()>::Clusters&,
-    const unsigned char*
-);
+void reportPredict(MNISTKMeansMPI&, const MNISTKMeansMPI::Clusters&, const MNISTPixel*, int);
 
 /**
- * Creates an HTML visualization of the clustered MNIST images.
- * @param clusters The final clusters after convergence.
+ * Saves the fitted model, refits the same images warm-started from the saved file
+ * and prints generations and wall time of both fits. Every other rank must call
+ * prepareWarmRefit and fitWork at the same time.
+ * @param kMeans The cold-fitted model.
  * @param images Pointer to the MNIST image data.
- * @param filename The name of the HTML file to be generated.
+ * @param n Number of images.
+ * @param coldSeconds Wall time of the cold fit.
  */
-void generateHTML(
-    const MNISTKMeansMPI<K, MNISTPixel::getNumPixels()>::Clusters&,
-    const MNISTPixel*,
-    const string&
-);
+void reportWarmStart(MNISTKMeansMPI&, const MNISTPixel*, int, double);
 
 /**
- * Generates an HTML table cell representing a single MNIST image.
- * @param f Reference to the output file stream.
- * @param image The MNIST image to be displayed.
+ * Prepares a fitted model for the warm refit: no profile report, no rebalancing,
+ * since the refit only takes a few generations. Must be called on every rank.
+ * @param kMeans The model to refit.
  */
-void createHTMLCell(ofstream&, const MNISTPixel&);
+void prepareWarmRefit(MNISTKMeansMPI&);
 
 /**
- * Generates a random hex color for the HTML background.
- * @return A string representing a random hex color code.
+ * Displays the k-means clustering results, showing MNIST labels grouped by clusters.
+ * @param clusters The final clusters after convergence.
+ * @param labels Pointer to the MNIST label data.
  */
-string generateRandomHexColor();
+void displayClusters(
+    const MNISTKMeansMPI::Clusters&,
+    const unsigned char*
+);
 
 int main() {
     MNISTPixel* images = nullptr;
     unsigned char* labels = nullptr;
+    double coldSeconds = 0;
 
     MPI_Init(nullptr, nullptr);
     int rank;
     MPI_Comm_rank(MPI_COMM_WORLD, &rank);
 
     // Initialize k-means clustering
-    MNISTKMeansMPI<K, MNISTPixel::getNumPixels()> kMeans;
+    MNISTKMeansMPI kMeans(K);
+    kMeans.setAdaptivePartitioning(true);
+    kMeans.setProfileReport("kmeans_profile.json");
 
     // Load MNIST data and run clustering on the root process
     if (rank == ROOT) {
@@ -108,21 +117,29 @@ int main() {
         int labels_n;
         loadMNISTImages(&images, &images_n);
         loadMNISTLabels(&labels, &labels_n);
+        double start = MPI_Wtime();
         kMeans.fit(images, images_n);
+        coldSeconds = MPI_Wtime() - start;
     } else {
+        kMeans.fitWork(rank);
+        prepareWarmRefit(kMeans);
         kMeans.fitWork(rank);
         MPI_Finalize();
         return 0;
     }
 
     // Retrieve final clustering results
-    MNISTKMeansMPI<K, MNISTPixel::getNumPixels()>::Clusters clusters = kMeans.getClusters();
+    MNISTKMeansMPI::Clusters clusters = kMeans.getClusters();
 
     // Display and visualize the clustering results
     displayClusters(clusters, labels);
-    string filename = "kmeans_mnist_mpi.html";
-    generateHTML(clusters, images, filename);
-    cout << "\n Visualization complete! Open '" << filename << "' in your browser to explore the clusters. \n\n";
+    reportPredict(kMeans, clusters, images, IMAGE_MAX);
+    reportWarmStart(kMeans, images, IMAGE_MAX, coldSeconds);
+    string prefix = "kmeans_mnist_mpi";
+    ClusterAtlas::Report report = ClusterAtlas::write(clusters, images, prefix);
+    cout << "\n Wrote " << report.files << " files (" << report.bytes / 1024 << " KiB) in "
+         << report.seconds * 1000 << " ms";
+    cout << "\n Visualization complete! Open '" << prefix << ".html' in your browser to explore the clusters. \n\n";
 
     delete[] images;
     delete[] labels;
@@ -180,7 +197,7 @@ uint32_t swapEndian(uint32_t i) {
 }
 
 void displayClusters(
-    const MNISTKMeansMPI<K, MNISTPixel::getNumPixels()>::Clusters& clusters,
+    const MNISTKMeansMPI::Clusters& clusters,
     const unsigned char* labels
 ) {
     cout << "\n MNIST Cluster Report:\n";
@@ -192,41 +209,50 @@ void displayClusters(
     }
 }
 
-void generateHTML(
-    const MNISTKMeansMPI<K, MNISTPixel::getNumPixels()>::Clusters& clusters,
+void reportPredict(
+    MNISTKMeansMPI& kMeans,
+    const MNISTKMeansMPI::Clusters& clusters,
     const MNISTPixel* images,
-    const string& filename
+    int n
 ) {
-    ofstream f(filename);
-    f << "<body style=\"background:#" << generateRandomHexColor() << ";\">";
-    f << "<table><tbody><tr style=\"vertical-align:top;\">\n";
-    for (const auto& cluster : clusters) {
-        f << "\t<td><table><tbody>\n";
-        createHTMLCell(f, cluster.centroid);
-        for (const auto& i : cluster.elements)
-            createHTMLCell(f, images[i]);
-        f << "</tbody></table></td>\n";
-    }
-    f << "</tr></tbody></table></body>\n";
+    const int BATCH = 32;
+    vector<int> expected(n), labels(n);
+    for (size_t c = 0; c < clusters.size(); c++)
+        for (int i : clusters[c].elements)
+            expected[i] = c;
+
+    const unsigned char* points = reinterpret_cast<const unsigned char*>(images);
+    for (int start = 0; start < n; start += BATCH)
+        kMeans.predict(points + (size_t)start * MNISTPixel::getNumPixels(), min(BATCH, n - start), &labels[start]);
+
+    int mismatches = 0;
+    for (int i = 0; i < n; i++)
+        mismatches += labels[i] != expected[i];
+    PredictStats stats = kMeans.getPredictStats();
+    cout << "\n Predict: " << stats.batches << " batches of up to " << BATCH << " images, "
+         << mismatches << " labels differ from the fit\n"
+         << " latency p50 " << stats.p50 * 1e6 << " us, p95 " << stats.p95 * 1e6
+         << " us, p99 " << stats.p99 * 1e6 << " us; " << stats.pointsPerSecond << " images/s\n";
 }
 
-void createHTMLCell(ofstream& f, const MNISTPixel& image) {
-    f << "\t\t<tr><td><table style=\"border-collapse:collapse;\"><tbody>\n";
-    for (int row = 0; row < MNISTPixel::getNumRows(); row++) {
-        f << "\t\t\t<tr>\n";
-        for (int col = 0; col < MNISTPixel::getNumCols(); col++) {
-            f << "\t\t\t\t<td style=\"background:#" << image.getPixelHex(row, col) << ";";
-            f << "width:5px;height:5px;\"></td>\n";
-        }
-        f << "\t\t\t</tr>\n";
-    }
-    f << "\t\t</tbody></table></td></tr>\n";
+void prepareWarmRefit(MNISTKMeansMPI& kMeans) {
+    kMeans.setProfileReport("");
+    kMeans.setAdaptivePartitioning(false);
 }
 
-string generateRandomHexColor() {
-    mt19937 rng(random_device{}());
-    uniform_int_distribution<> distrib(0, 255);
-    char buffer[7];
-    snprintf(buffer, sizeof(buffer), "%02x%02x%02x", distrib(rng), distrib(rng), distrib(rng));
-    return string(buffer);
+void reportWarmStart(MNISTKMeansMPI& kMeans, const MNISTPixel* images, int n, double coldSeconds) {
+    int coldGenerations = kMeans.getGenerations();
+    double coldInertia = kMeans.getInertia();
+    bool loaded = kMeans.saveModel(MODEL_FILEPATH) && kMeans.loadModel(MODEL_FILEPATH);
+
+    prepareWarmRefit(kMeans);
+    double start = MPI_Wtime();
+    kMeans.fit(images, n);
+    double warmSeconds = MPI_Wtime() - start;
+
+    cout << "\n Model " << (loaded ? "saved to and loaded from " + MODEL_FILEPATH : "could not be saved")
+         << "\n cold start: " << coldGenerations << " generations, " << coldSeconds * 1000
+         << " ms, inertia " << coldInertia
+         << "\n warm start: " << kMeans.getGenerations() << " generations, " << warmSeconds * 1000
+         << " ms, inertia " << kMeans.getInertia() << endl;
 }
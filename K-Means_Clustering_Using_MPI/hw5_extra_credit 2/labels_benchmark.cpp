@@ -0,0 +1,114 @@
+/**
+ * @file labels_benchmark.cpp
+ * @brief Compares gathering the labels at ROOT with writing them by MPI-IO.
+ *
+ *     mpirun -n P ./labels_benchmark [n] [d] [k] [file]
+ *
+ * Every rank generates n / P points of its own and fits them with fitLocal,
+ * once writing the labels to file with setLabelFile and once gathering them
+ * at ROOT. Both fits start from the same seed. The report gives the time
+ * of the label phase on the slowest rank, ROOT's resident memory after each
+ * fit, and whether the file matches the gathered labels point for point.
+ */
+
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <unistd.h>
+#include <vector>
+#include "KMeansMPI.h"
+#include "mpi.h"
+
+using namespace std;
+
+const int ROOT = 0;
+
+/**
+ * @return resident set size of this process in KiB, from /proc/self/statm
+ */
+long residentKiB() {
+    long pages = 0, resident = 0;
+    ifstream statm("/proc/self/statm");
+    statm >> pages >> resident;
+    return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+/**
+ * Makes n points of dimension d scattered around k random centers, the same
+ * centers on every rank.
+ */
+vector<unsigned char> makeBlobs(int n, int d, int k, unsigned seed, int rank) {
+    mt19937 rng(seed);
+    uniform_int_distribution<int> centerDist(20, 235), noise(-20, 20), pick(0, k - 1);
+    vector<unsigned char> centers((size_t)k * d), points((size_t)n * d);
+    for (auto& c : centers)
+        c = centerDist(rng);
+    rng.seed(seed + 1 + rank);
+    for (int i = 0; i < n; i++) {
+        int c = pick(rng);
+        for (int j = 0; j < d; j++)
+            points[(size_t)i * d + j] = centers[(size_t)c * d + j] + noise(rng);
+    }
+    return points;
+}
+
+/**
+ * Fits kMeans on this rank's points and reports the label phase.
+ * @return time of the label phase on the slowest rank, in seconds (at ROOT)
+ */
+double fitAndTime(KMeansMPI& kMeans, const vector<unsigned char>& points, int n, int d) {
+    kMeans.setSeed(13);
+    kMeans.fitLocal(points.data(), n, d);
+    double mine = kMeans.getProfiler().totalSeconds(KMeansProfiler::COLLECT_CLUSTER_ASSIGNMENTS), slowest;
+    MPI_Reduce(&mine, &slowest, 1, MPI_DOUBLE, MPI_MAX, ROOT, MPI_COMM_WORLD);
+    return slowest;
+}
+
+int main(int argc, char* argv[]) {
+    MPI_Init(&argc, &argv);
+    int rank, processes;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &processes);
+    int n = argc > 1 ? stoi(argv[1]) : 2000000;
+    int d = argc > 2 ? stoi(argv[2]) : 8;
+    int k = argc > 3 ? stoi(argv[3]) : 16;
+    string file = argc > 4 ? argv[4] : "labels.bin";
+
+    int mine = n / processes + (rank < n % processes);
+    vector<unsigned char> points = makeBlobs(mine, d, k, 21, rank);
+
+    // Written first, since resident memory rarely shrinks once the gather has grown it
+    KMeansMPI written(k);
+    written.setLabelFile(file);
+    double writeSeconds = fitAndTime(written, points, mine, d);
+    long writeKiB = residentKiB();
+
+    KMeansMPI gathered(k);
+    double gatherSeconds = fitAndTime(gathered, points, mine, d);
+
+    if (rank == ROOT) {
+        // Compare the file with the gathered labels, one cluster at a time
+        vector<int> fromFile(n);
+        ifstream in(file, ios::binary);
+        in.read(reinterpret_cast<char*>(fromFile.data()), (streamsize)n * sizeof(int));
+        bool same = (bool)in && gathered.getGenerations() == written.getGenerations();
+        long long weights = 0;
+        for (int j = 0; j < k; j++) {
+            const KMeansMPI::Cluster& cluster = gathered.getClusters()[j];
+            for (int i : cluster.elements)
+                same = same && fromFile[i] == j;
+            same = same && written.getClusters()[j].weight == (int)cluster.elements.size();
+            weights += written.getClusters()[j].weight;
+        }
+        same = same && weights == n;
+
+        cout << "ranks=" << processes << " n=" << n << " d=" << d << " k=" << k << endl;
+        cout << "mpi-io labels_ms=" << writeSeconds * 1000 << " root_rss_kib=" << writeKiB
+             << " file_matches=" << (same ? "yes" : "no") << endl;
+        cout << "gather labels_ms=" << gatherSeconds * 1000 << " root_rss_kib=" << residentKiB() << endl;
+    }
+
+    MPI_Finalize();
+    return 0;
+}
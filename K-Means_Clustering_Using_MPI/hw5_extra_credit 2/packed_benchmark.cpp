@@ -0,0 +1,130 @@
+/**
+ * @file packed_benchmark.cpp
+ * @brief Measures 4-bit packed points against exact dense ones on MNIST.
+ *
+ *     mpirun -n P ./packed_benchmark [k] [copies]
+ *
+ * The MNIST images are repeated copies times, so the partition is well beyond
+ * the caches. The same data is fitted from the same initial centroids three
+ * ways: DENSE, PACKED without refinement and PACKED with exact refinement. Each
+ * fit reports its generations, the distance time per generation on the slowest
+ * rank, the point bytes streamed per generation, the inertia and the fraction
+ * of points labelled as in the dense fit. A second line gives ROOT's hardware
+ * counters over its distance passes, as IPC and misses per point per generation.
+ */
+
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "KMeansMPI.h"
+#include "mpi.h"
+
+using namespace std;
+
+const int ROOT = 0;
+const string MNIST_IMAGES_FILEPATH = "./images-idx3-ubyte";
+
+/**
+ * Reads an idx3 image file, whose header holds big-endian 32-bit fields.
+ * @return the images, row-major, rows x cols values each; empty if unreadable
+ */
+vector<unsigned char> readImages(const string& path, int& d) {
+    ifstream file(path, ios::binary);
+    unsigned char header[16];
+    if (!file.read(reinterpret_cast<char*>(header), sizeof(header)))
+        return {};
+    auto field = [&](int at) {
+        return (int)header[at] << 24 | (int)header[at + 1] << 16 | (int)header[at + 2] << 8 | (int)header[at + 3];
+    };
+    int n = field(4);
+    d = field(8) * field(12);
+    vector<unsigned char> images((size_t)n * d);
+    file.read(reinterpret_cast<char*>(images.data()), images.size());
+    images.resize(file.gcount() / d * d);
+    return images;
+}
+
+/**
+ * @return the label of every point from ROOT's clusters
+ */
+vector<int> labelsOf(KMeansMPI& kMeans, int n) {
+    vector<int> labels(n);
+    const KMeansMPI::Clusters& clusters = kMeans.getClusters();
+    for (int j = 0; j < (int)clusters.size(); j++)
+        for (int i : clusters[j].elements)
+            labels[i] = j;
+    return labels;
+}
+
+int main(int argc, char* argv[]) {
+    MPI_Init(&argc, &argv);
+    int rank, processes;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &processes);
+    int k = argc > 1 ? stoi(argv[1]) : 10;
+    int copies = argc > 2 ? stoi(argv[2]) : 4;
+
+    int d = 0, n = 0;
+    vector<unsigned char> points;
+    if (rank == ROOT) {
+        vector<unsigned char> images = readImages(MNIST_IMAGES_FILEPATH, d);
+        for (int c = 0; c < copies; c++)
+            points.insert(points.end(), images.begin(), images.end());
+        n = d > 0 ? points.size() / d : 0;
+        if (n == 0)
+            cerr << "could not read " << MNIST_IMAGES_FILEPATH << endl;
+    }
+    MPI_Bcast(&n, 1, MPI_INT, ROOT, MPI_COMM_WORLD);
+    if (n == 0) {
+        MPI_Finalize();
+        return 1;
+    }
+
+    struct Variant {
+        const char* name;
+        KMeansMPI::Representation representation;
+        bool refine;
+    };
+    vector<int> exact;
+    for (Variant variant : {Variant{"dense", KMeansMPI::DENSE, false},
+                            Variant{"packed", KMeansMPI::PACKED, false},
+                            Variant{"packed+refine", KMeansMPI::PACKED, true}}) {
+        KMeansMPI kMeans(k);
+        kMeans.setSeed(29);
+        kMeans.setRepresentation(variant.representation);
+        kMeans.setHardwareCounters(true);
+        kMeans.setPackedRefinement(variant.refine);
+        MPI_Barrier(MPI_COMM_WORLD);
+        double start = MPI_Wtime();
+        if (rank == ROOT)
+            kMeans.fit(points.data(), n, d);
+        else
+            kMeans.fitWork(rank);
+        double seconds = MPI_Wtime() - start;
+
+        double mine = kMeans.getProfiler().totalSeconds(KMeansProfiler::UPDATE_DISTANCES), slowest;
+        MPI_Reduce(&mine, &slowest, 1, MPI_DOUBLE, MPI_MAX, ROOT, MPI_COMM_WORLD);
+        if (rank == ROOT) {
+            vector<int> labels = labelsOf(kMeans, n);
+            if (exact.empty())
+                exact = labels;
+            int agree = 0;
+            for (int i = 0; i < n; i++)
+                agree += labels[i] == exact[i];
+            int generations = kMeans.getGenerations();
+            size_t streamed = (size_t)n * (variant.representation == KMeansMPI::PACKED ? (d + 1) / 2 : d);
+            cout << variant.name << " ranks=" << processes << " n=" << n << " k=" << k
+                 << " generations=" << generations << " fit_ms=" << seconds * 1000
+                 << " distance_ms_per_generation=" << slowest * 1000 / max(generations, 1)
+                 << " streamed_mb_per_generation=" << streamed / 1e6
+                 << " inertia=" << kMeans.getInertia() << " label_agreement=" << (double)agree / n << endl;
+            PerfRegion::printCounts(cout, string(variant.name) + " distances",
+                                    kMeans.getProfiler().totalCounts(KMeansProfiler::UPDATE_DISTANCES),
+                                    (double)n / processes * generations);
+        }
+    }
+
+    MPI_Finalize();
+    return 0;
+}
@@ -0,0 +1,87 @@
+/**
+ * @file quantize_benchmark.cpp
+ * @brief Times palette quantization of a large synthetic RGB image with ColorQuantizer.
+ *
+ *     mpirun -n P ./quantize_benchmark [megapixels] [k] [histogram bits]
+ *
+ * The image is a set of smooth color gradients plus a little noise, which gives a
+ * photo-like number of distinct colors. The report breaks the time into building
+ * the histogram, the weighted fit over the distinct colors, and mapping the pixels.
+ */
+
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "ColorQuantizer.h"
+#include "mpi.h"
+
+using namespace std;
+
+const int ROOT = 0;
+const int CHANNELS = 3;
+
+/**
+ * Makes a width x height RGB image of overlapping gradients with +-4 noise.
+ */
+vector<unsigned char> makeImage(int width, int height) {
+    vector<unsigned char> image((size_t)width * height * CHANNELS);
+    ColorHistogram::parallel(thread::hardware_concurrency(), height, [&](int, size_t from, size_t to) {
+        for (size_t y = from; y < to; y++)
+            for (int x = 0; x < width; x++) {
+                double u = (double)x / width, v = (double)y / height;
+                double base[CHANNELS] = {
+                    128 + 100 * sin(6 * u + 2 * v),
+                    128 + 100 * cos(4 * v - 3 * u * v),
+                    128 + 100 * sin(5 * (u + v))
+                };
+                uint32_t h = (uint32_t)(x * 73856093u) ^ (uint32_t)(y * 19349663u);
+                for (int c = 0; c < CHANNELS; c++) {
+                    h = h * 1664525u + 1013904223u;
+                    int value = (int)base[c] + (int)(h >> 29) - 4;
+                    image[((size_t)y * width + x) * CHANNELS + c] = min(255, max(0, value));
+                }
+            }
+    });
+    return image;
+}
+
+int main(int argc, char* argv[]) {
+    MPI_Init(&argc, &argv);
+    int rank, processes;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &processes);
+    double megapixels = argc > 1 ? stod(argv[1]) : 50;
+    int k = argc > 2 ? stoi(argv[2]) : 256;
+    int bits = argc > 3 ? stoi(argv[3]) : ColorQuantizer::HISTOGRAM_BITS;
+
+    ColorQuantizer quantizer(k);
+    quantizer.setHistogramBits(bits);
+    if (rank != ROOT) {
+        quantizer.fitWork(rank);
+        MPI_Finalize();
+        return 0;
+    }
+
+    int width = (int)sqrt(megapixels * 1e6 * 4 / 3), height = (int)(megapixels * 1e6 / width);
+    size_t n = (size_t)width * height;
+    vector<unsigned char> image = makeImage(width, height), quantized(image.size());
+    ColorQuantizer::Report report = quantizer.quantize(image.data(), n, CHANNELS, quantized.data());
+
+    double squaredError = 0;
+    for (size_t i = 0; i < image.size(); i++) {
+        double diff = (double)image[i] - quantized[i];
+        squaredError += diff * diff;
+    }
+    cout << "ranks=" << processes << " pixels=" << n << " k=" << k << " bits=" << bits
+         << " distinct_colors=" << report.distinctColors
+         << " generations=" << report.generations
+         << " histogram_ms=" << report.histogramSeconds * 1000
+         << " fit_ms=" << report.fitSeconds * 1000
+         << " map_ms=" << report.mapSeconds * 1000
+         << " total_ms=" << (report.histogramSeconds + report.fitSeconds + report.mapSeconds) * 1000
+         << " rmse=" << sqrt(squaredError / image.size()) << endl;
+
+    MPI_Finalize();
+    return 0;
+}
@@ -0,0 +1,120 @@
+/**
+ * @file scaling_benchmark.cpp
+ * @brief Strong- and weak-scaling series for KMeansMPI on generated data, as CSV.
+ *
+ *     ./scaling_benchmark header
+ *     mpirun -n P ./scaling_benchmark strong|weak [n] [d] [k] [seed]
+ *
+ * Each rank generates its own block of a Gaussian-blob dataset with fitLocal, so
+ * there is no I/O and no rank holds the whole dataset. Under strong scaling
+ * there are n points in total. Under weak scaling there are n points per rank.
+ *
+ * Points are generated in fixed chunks, each from its own seeded generator.
+ * The dataset is therefore the same whichever rank generates a point, and the
+ * initial centroids are seeded as well. Runs with different P cluster the same
+ * data from the same start. `make run_scaling_benchmark` writes both series for
+ * P = 1..4.
+ *
+ * Each run prints one CSV row. The per-generation compute (distances and
+ * cluster updates) and communication (combining and broadcasting) times are
+ * taken from the slowest rank.
+ */
+
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include "KMeansMPI.h"
+#include "mpi.h"
+
+using namespace std;
+
+const int ROOT = 0;
+/// Points generated from one seeded generator
+const int CHUNK = 4096;
+/// Standard deviation of each blob, per dimension
+const double SPREAD = 12;
+
+/**
+ * Generates points [from, to) of a dataset of Gaussian blobs around k centers.
+ * Any rank can generate any range, and every range agrees with every other.
+ */
+vector<unsigned char> makeBlobs(long long from, long long to, int d, int k, unsigned seed) {
+    mt19937 centerRng(seed);
+    uniform_int_distribution<int> centerDist(30, 225);
+    vector<unsigned char> centers((size_t)k * d);
+    for (auto& c : centers)
+        c = centerDist(centerRng);
+
+    vector<unsigned char> points((size_t)(to - from) * d);
+    for (long long chunk = from / CHUNK; chunk * CHUNK < to; chunk++) {
+        mt19937 rng(seed ^ (unsigned)(chunk * 2654435761u));
+        uniform_int_distribution<int> pick(0, k - 1);
+        normal_distribution<double> noise(0, SPREAD);
+        for (long long i = chunk * CHUNK; i < (chunk + 1) * CHUNK && i < to; i++) {
+            int c = pick(rng);
+            for (int j = 0; j < d; j++) {
+                int value = (int)lround(centers[(size_t)c * d + j] + noise(rng));
+                if (i >= from)
+                    points[(size_t)(i - from) * d + j] = min(255, max(0, value));
+            }
+        }
+    }
+    return points;
+}
+
+int main(int argc, char* argv[]) {
+    MPI_Init(&argc, &argv);
+    int rank, processes;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &processes);
+    string mode = argc > 1 ? argv[1] : "strong";
+    if (mode == "header") {
+        if (rank == ROOT)
+            cout << "mode,ranks,n,d,k,generations,total_ms,ms_per_generation,"
+                    "compute_ms_per_generation,comm_ms_per_generation,comm_fraction" << endl;
+        MPI_Finalize();
+        return 0;
+    }
+    if (mode != "strong" && mode != "weak") {
+        if (rank == ROOT)
+            cerr << "usage: mpirun -n P ./scaling_benchmark strong|weak [n] [d] [k] [seed]" << endl;
+        MPI_Finalize();
+        return 1;
+    }
+    long long n = argc > 2 ? stoll(argv[2]) : 400000;
+    int d = argc > 3 ? stoi(argv[3]) : 16;
+    int k = argc > 4 ? stoi(argv[4]) : 32;
+    unsigned seed = argc > 5 ? stoul(argv[5]) : 7;
+
+    long long total = mode == "weak" ? n * processes : n;
+    long long from = total * rank / processes, to = total * (rank + 1) / processes;
+    vector<unsigned char> points = makeBlobs(from, to, d, k, seed);
+
+    KMeansMPI kMeans(k);
+    kMeans.setSeed(seed);
+    MPI_Barrier(MPI_COMM_WORLD);
+    double start = MPI_Wtime();
+    kMeans.fitLocal(points.data(), to - from, d);
+    double seconds = MPI_Wtime() - start;
+
+    const KMeansProfiler& profiler = kMeans.getProfiler();
+    double mine[3] = {
+        seconds,
+        profiler.totalSeconds(KMeansProfiler::UPDATE_DISTANCES) + profiler.totalSeconds(KMeansProfiler::UPDATE_CLUSTERS),
+        profiler.totalSeconds(KMeansProfiler::COMBINE_CLUSTERS) + profiler.totalSeconds(KMeansProfiler::DISTRIBUTE_CENTROIDS)
+    };
+    double slowest[3];
+    MPI_Reduce(mine, slowest, 3, MPI_DOUBLE, MPI_MAX, ROOT, MPI_COMM_WORLD);
+    if (rank == ROOT) {
+        int generations = kMeans.getGenerations(), g = max(generations, 1);
+        cout << mode << "," << processes << "," << total << "," << d << "," << k << "," << generations << ","
+             << slowest[0] * 1000 << "," << slowest[0] * 1000 / g << ","
+             << slowest[1] * 1000 / g << "," << slowest[2] * 1000 / g << ","
+             << slowest[2] / max(slowest[1] + slowest[2], 1e-12) << endl;
+    }
+
+    MPI_Finalize();
+    return 0;
+}
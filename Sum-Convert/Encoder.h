@@ -0,0 +1,26 @@
+/**
+ * @file Encoder.h - the step of hw1's encode() and its table-driven form
+ * @author Zhou Liu
+ * @see "Seattle University, CPSC5600, Winter 2025"
+ *
+ * Shared by hw1.cpp, which encodes with it, and transform_check.cpp, which
+ * checks it against the plain loop.
+ */
+#pragma once
+#include "TransformTable.h"
+
+/**
+ * @struct EncodeStep - one step of encode(): v(v+1) mod 10
+ *
+ * v(v+1) is worked out in unsigned arithmetic, which wraps mod 2^32 where the
+ * int product would overflow (|v| > 46340), and read back as an int, which may
+ * then be negative. Any int % 10 lies in -9..9, so one step lands every int in
+ * that domain, and the step maps it into itself.
+ */
+struct EncodeStep {
+	static constexpr int apply(int v) {
+		return (int)((unsigned)v * (unsigned)v + (unsigned)v) % 10;
+	}
+};
+
+typedef IteratedMap<EncodeStep, 500, -9, 9> Encoder;
@@ -0,0 +1,253 @@
+/**
+ * @file LargeArray.h - page- and NUMA-aware storage for large benchmark arrays
+ * @author Zhou Liu
+ * @see "Seattle University, CPSC5600, Winter 2025"
+ *
+ * An array made with new int[n] and filled on the main thread has every page
+ * placed on the main thread's NUMA node, and at 10^9 elements its 4 KiB pages
+ * miss the TLB constantly. A LargeArray instead maps its own memory and
+ *
+ * - backs it with 2 MiB pages, either transparent huge pages requested with
+ *   madvise(MADV_HUGEPAGE), or explicit ones from the hugetlbfs pool with
+ *   MAP_HUGETLB, which falls back to transparent pages if the pool is empty;
+ * - places pages either on first touch or interleaved across all online nodes
+ *   with mbind(MPOL_INTERLEAVE);
+ * - fills itself in parallel with firstTouch, split into the same contiguous
+ *   segments as the workers that will use it, so that each worker's pages land
+ *   on its own node.
+ *
+ * Arrays smaller than one huge page always use small pages. Only the mbind
+ * system call is used, so nothing needs to link with libnuma.
+ *
+ * @tparam T - trivial element type; elements start out zero
+ */
+#pragma once
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cstddef>
+#include <fstream>
+#include <new>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+template <typename T>
+class LargeArray {
+	static_assert(std::is_trivial<T>::value, "LargeArray elements must be trivial");
+
+public:
+	enum PageMode { SMALL_PAGES, TRANSPARENT_HUGE_PAGES, EXPLICIT_HUGE_PAGES };
+	enum Placement { FIRST_TOUCH, INTERLEAVE };
+	static const size_t HUGE_PAGE = 2 << 20;
+
+	/**
+	 * Maps zeroed memory for n elements. Nothing is placed until first touched.
+	 *
+	 * @param n           number of elements
+	 * @param wantedPages page size wanted; see pageMode() for what was granted
+	 * @param placement   where pages go when first touched
+	 * @throws std::bad_alloc if the memory cannot be mapped
+	 */
+	explicit LargeArray(size_t n, PageMode wantedPages = TRANSPARENT_HUGE_PAGES, Placement placement = FIRST_TOUCH)
+		: memory(nullptr), length(n), bytes(0), pages(SMALL_PAGES), interleaved(false) {
+		size_t wanted = n * sizeof(T) > 0 ? n * sizeof(T) : 1;
+		if (wanted < HUGE_PAGE)
+			wantedPages = SMALL_PAGES;
+		if (wantedPages == EXPLICIT_HUGE_PAGES)
+			mapExplicit(wanted);
+		if (memory == nullptr && wantedPages != SMALL_PAGES)
+			mapTransparent(wanted);
+		if (memory == nullptr)
+			mapSmall(wanted);
+		if (placement == INTERLEAVE)
+			interleaved = interleave();
+	}
+
+	~LargeArray() {
+		if (memory != nullptr)
+			munmap(memory, bytes);
+	}
+
+	LargeArray(const LargeArray &other) = delete;
+	LargeArray &operator=(const LargeArray &rhs) = delete;
+
+	LargeArray(LargeArray &&other)
+		: memory(other.memory), length(other.length), bytes(other.bytes), pages(other.pages),
+		  interleaved(other.interleaved) {
+		other.memory = nullptr;
+	}
+
+	/**
+	 * Sets element i to value(i) for every i, with the array split into threads
+	 * contiguous segments of n / threads elements (the last one taking the
+	 * rest), each written by its own thread. Use the workers' own split so that
+	 * each worker's pages are placed on the node it runs on.
+	 *
+	 * @param threads number of segments and threads
+	 * @param value   element for each index, called concurrently
+	 */
+	template <typename F>
+	void firstTouch(int threads, F value) {
+		if (threads < 1)
+			threads = 1;
+		size_t segSize = length / threads;
+		std::vector<std::thread> touchers;
+		for (int id = 0; id < threads; id++) {
+			size_t start = id * segSize;
+			size_t end = id == threads - 1 ? length : start + segSize;
+			touchers.emplace_back([this, start, end, &value] {
+				for (size_t i = start; i < end; i++)
+					data()[i] = value(i);
+			});
+		}
+		for (std::thread &toucher : touchers)
+			toucher.join();
+	}
+
+	T *data() {
+		return static_cast<T *>(memory);
+	}
+
+	const T *data() const {
+		return static_cast<const T *>(memory);
+	}
+
+	size_t size() const {
+		return length;
+	}
+
+	T &operator[](size_t i) {
+		return data()[i];
+	}
+
+	const T &operator[](size_t i) const {
+		return data()[i];
+	}
+
+	T *begin() {
+		return data();
+	}
+
+	T *end() {
+		return data() + length;
+	}
+
+	const T *begin() const {
+		return data();
+	}
+
+	const T *end() const {
+		return data() + length;
+	}
+
+	/**
+	 * @return the page size granted, which may be smaller than asked for
+	 */
+	PageMode pageMode() const {
+		return pages;
+	}
+
+	/**
+	 * @return true if pages are interleaved across more than one node
+	 */
+	bool isInterleaved() const {
+		return interleaved;
+	}
+
+	/**
+	 * @return online NUMA node numbers, from /sys/devices/system/node/online
+	 *         (just node 0 if that cannot be read)
+	 */
+	static std::vector<int> onlineNodes() {
+		std::vector<int> nodes;
+		std::ifstream online("/sys/devices/system/node/online");
+		std::string range;
+		while (std::getline(online, range, ',')) {
+			size_t dash = range.find('-');
+			int first = std::stoi(range.substr(0, dash));
+			int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+			for (int node = first; node <= last; node++)
+				nodes.push_back(node);
+		}
+		if (nodes.empty())
+			nodes.push_back(0);
+		return nodes;
+	}
+
+private:
+	static const int MPOL_INTERLEAVE_MODE = 3; // MPOL_INTERLEAVE in <linux/mempolicy.h>
+	void *memory;
+	size_t length;
+	size_t bytes;
+	PageMode pages;
+	bool interleaved;
+
+	static size_t roundUp(size_t size, size_t to) {
+		return (size + to - 1) / to * to;
+	}
+
+	void mapExplicit(size_t wanted) {
+#ifdef MAP_HUGETLB
+		size_t size = roundUp(wanted, HUGE_PAGE);
+		void *mapped = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+		if (mapped != MAP_FAILED) {
+			memory = mapped;
+			bytes = size;
+			pages = EXPLICIT_HUGE_PAGES;
+		}
+#else
+		(void)wanted;
+#endif
+	}
+
+	void mapTransparent(size_t wanted) {
+		// over-map by a huge page, then trim so the region starts on a huge-page boundary
+		size_t size = roundUp(wanted, HUGE_PAGE);
+		void *mapped = mmap(nullptr, size + HUGE_PAGE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (mapped == MAP_FAILED)
+			return;
+		char *raw = static_cast<char *>(mapped);
+		char *aligned = reinterpret_cast<char *>(roundUp(reinterpret_cast<size_t>(raw), HUGE_PAGE));
+		if (aligned > raw)
+			munmap(raw, aligned - raw);
+		if (raw + HUGE_PAGE > aligned)
+			munmap(aligned + size, raw + HUGE_PAGE - aligned);
+		memory = aligned;
+		bytes = size;
+#ifdef MADV_HUGEPAGE
+		if (madvise(memory, bytes, MADV_HUGEPAGE) == 0)
+			pages = TRANSPARENT_HUGE_PAGES;
+#endif
+	}
+
+	void mapSmall(size_t wanted) {
+		size_t size = roundUp(wanted, sysconf(_SC_PAGESIZE));
+		void *mapped = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (mapped == MAP_FAILED)
+			throw std::bad_alloc();
+		memory = mapped;
+		bytes = size;
+		pages = SMALL_PAGES;
+	}
+
+	/**
+	 * Sets an interleave policy over all online nodes on the untouched mapping.
+	 * @return true if there is more than one node and the policy was set
+	 */
+	bool interleave() {
+#ifdef SYS_mbind
+		std::vector<int> nodes = onlineNodes();
+		if (nodes.size() < 2)
+			return false;
+		const size_t BITS = 8 * sizeof(unsigned long);
+		std::vector<unsigned long> mask(nodes.back() / BITS + 1, 0);
+		for (int node : nodes)
+			mask[node / BITS] |= 1UL << (node % BITS);
+		return syscall(SYS_mbind, memory, bytes, MPOL_INTERLEAVE_MODE, mask.data(), mask.size() * BITS + 1, 0) == 0;
+#else
+		return false;
+#endif
+	}
+};
@@ -0,0 +1,257 @@
+/**
+ * @file PerfCounters.h - hardware performance counters per code region and thread
+ * @author Zhou Liu
+ * @see "Seattle University, CPSC5600, Winter 2025"
+ *
+ * Wall-clock time alone does not say whether a kernel is bound by compute, by
+ * memory latency or by bandwidth. This wraps perf_event_open to count, for the
+ * calling thread only and in user mode only:
+ *
+ *     cycles, instructions, cache misses (last level), branch misses, dTLB read misses
+ *
+ * Each thread opens its counters once, on first use, and they run from then on.
+ * A PerfScope reads them when it is made and again when it is destroyed, and adds
+ * the difference to a PerfRegion. A PerfRegion keeps totals per thread and
+ * overall, and prints IPC and misses per element.
+ *
+ *     PerfRegion sorting("bitonic sort");
+ *     {
+ *         PerfScope scope(sorting);
+ *         bitonic.sort();
+ *     }
+ *     sorting.print(cout, n);
+ *
+ * An event that cannot be opened (no PMU in a VM, perf_event_paranoid too high,
+ * an event the CPU lacks) is left out and printed as n/a. Time is still
+ * measured. Counts are scaled for multiplexing when the kernel time-shares the
+ * hardware counters.
+ */
+#pragma once
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <chrono>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+
+/**
+ * @struct PerfCounts - event counts and elapsed time over some stretch of code
+ */
+struct PerfCounts {
+	enum Event { CYCLES, INSTRUCTIONS, CACHE_MISSES, BRANCH_MISSES, DTLB_MISSES, NUM_EVENTS };
+
+	long long value[NUM_EVENTS];
+	bool counted[NUM_EVENTS];
+	double seconds;
+
+	PerfCounts() : value(), counted(), seconds(0) {
+	}
+
+	PerfCounts &operator+=(const PerfCounts &other) {
+		for (int e = 0; e < NUM_EVENTS; e++) {
+			value[e] += other.value[e];
+			counted[e] = counted[e] || other.counted[e];
+		}
+		seconds += other.seconds;
+		return *this;
+	}
+
+	PerfCounts operator-(const PerfCounts &start) const {
+		PerfCounts diff = *this;
+		for (int e = 0; e < NUM_EVENTS; e++)
+			diff.value[e] -= start.value[e];
+		diff.seconds -= start.seconds;
+		return diff;
+	}
+
+	/**
+	 * @return instructions per cycle, or a negative number if either is not counted
+	 */
+	double ipc() const {
+		if (!counted[CYCLES] || !counted[INSTRUCTIONS] || value[CYCLES] == 0)
+			return -1;
+		return (double)value[INSTRUCTIONS] / value[CYCLES];
+	}
+
+	static const char *name(int event) {
+		static const char *names[NUM_EVENTS] = {
+			"cycles", "instructions", "cache_misses", "branch_misses", "dtlb_misses"
+		};
+		return names[event];
+	}
+};
+
+/**
+ * @class PerfCounters - the calling thread's open counters
+ */
+class PerfCounters {
+public:
+	/**
+	 * @return this thread's counters, opened on first use
+	 */
+	static PerfCounters &thisThread() {
+		thread_local PerfCounters counters;
+		return counters;
+	}
+
+	~PerfCounters() {
+		for (int e = 0; e < PerfCounts::NUM_EVENTS; e++)
+			if (fd[e] >= 0)
+				close(fd[e]);
+	}
+
+	PerfCounters(const PerfCounters &other) = delete;
+	PerfCounters &operator=(const PerfCounters &rhs) = delete;
+
+	/**
+	 * @return true if at least one event is being counted
+	 */
+	bool available() const {
+		for (int e = 0; e < PerfCounts::NUM_EVENTS; e++)
+			if (fd[e] >= 0)
+				return true;
+		return false;
+	}
+
+	/**
+	 * @return counts since the counters were opened, and the time now
+	 */
+	PerfCounts read() const {
+		PerfCounts counts;
+		counts.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+		for (int e = 0; e < PerfCounts::NUM_EVENTS; e++) {
+			// value, time enabled, time running
+			unsigned long long raw[3];
+			if (fd[e] < 0 || ::read(fd[e], raw, sizeof(raw)) != sizeof(raw))
+				continue;
+			counts.counted[e] = true;
+			counts.value[e] = raw[2] == 0 || raw[2] == raw[1]
+				? (long long)raw[0]
+				: (long long)((double)raw[0] * raw[1] / raw[2]);
+		}
+		return counts;
+	}
+
+private:
+	int fd[PerfCounts::NUM_EVENTS];
+
+	PerfCounters() {
+		const unsigned long long DTLB_READ_MISS = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+			| (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+		fd[PerfCounts::CYCLES] = open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+		fd[PerfCounts::INSTRUCTIONS] = open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+		fd[PerfCounts::CACHE_MISSES] = open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+		fd[PerfCounts::BRANCH_MISSES] = open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+		fd[PerfCounts::DTLB_MISSES] = open(PERF_TYPE_HW_CACHE, DTLB_READ_MISS);
+	}
+
+	/**
+	 * @return a file descriptor counting the event for this thread, or -1
+	 */
+	static int open(unsigned type, unsigned long long config) {
+		perf_event_attr attr;
+		memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = type;
+		attr.config = config;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+		return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+	}
+};
+
+/**
+ * @class PerfRegion - counts accumulated over every PerfScope of one region
+ */
+class PerfRegion {
+public:
+	explicit PerfRegion(const std::string &name) : name(name) {
+	}
+
+	/**
+	 * Adds one scope's counts from the calling thread.
+	 */
+	void add(const PerfCounts &counts) {
+		std::lock_guard<std::mutex> guard(lock);
+		perThread[std::this_thread::get_id()] += counts;
+	}
+
+	/**
+	 * @return counts over all threads
+	 */
+	PerfCounts total() const {
+		std::lock_guard<std::mutex> guard(lock);
+		PerfCounts sum;
+		for (const auto &thread : perThread)
+			sum += thread.second;
+		return sum;
+	}
+
+	/**
+	 * Prints one line for the region: time, IPC, and each counted event per
+	 * element processed. With several threads, one more line per thread follows.
+	 *
+	 * @param out      where to print
+	 * @param elements elements the region processed, for misses per element
+	 */
+	void print(std::ostream &out, double elements) const {
+		printCounts(out, name, total(), elements);
+		std::lock_guard<std::mutex> guard(lock);
+		if (perThread.size() > 1) {
+			int t = 0;
+			for (const auto &thread : perThread)
+				printCounts(out, name + " thread " + std::to_string(t++), thread.second, elements);
+		}
+	}
+
+	/**
+	 * Prints one line of counts, as print does, for counts kept elsewhere.
+	 */
+	static void printCounts(std::ostream &out, const std::string &label, const PerfCounts &counts, double elements) {
+		out << label << ": ms=" << counts.seconds * 1000 << " ipc=";
+		if (counts.ipc() < 0)
+			out << "n/a";
+		else
+			out << counts.ipc();
+		for (int e = PerfCounts::CACHE_MISSES; e < PerfCounts::NUM_EVENTS; e++) {
+			out << " " << PerfCounts::name(e) << "_per_element=";
+			if (counts.counted[e] && elements > 0)
+				out << counts.value[e] / elements;
+			else
+				out << "n/a";
+		}
+		out << std::endl;
+	}
+
+private:
+	std::string name;
+	mutable std::mutex lock;
+	std::map<std::thread::id, PerfCounts> perThread;
+};
+
+/**
+ * @class PerfScope - counts the calling thread from construction to destruction
+ */
+class PerfScope {
+public:
+	explicit PerfScope(PerfRegion &region)
+		: region(region), counters(PerfCounters::thisThread()), start(counters.read()) {
+	}
+
+	~PerfScope() {
+		region.add(counters.read() - start);
+	}
+
+	PerfScope(const PerfScope &other) = delete;
+	PerfScope &operator=(const PerfScope &rhs) = delete;
+
+private:
+	PerfRegion &region;
+	PerfCounters &counters;
+	PerfCounts start;
+};
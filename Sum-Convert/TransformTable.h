@@ -0,0 +1,113 @@
+/**
+ * @file TransformTable.h - compile-time tables for iterated pure transforms
+ * @author Zhou Liu
+ * @see "Seattle University, CPSC5600, Winter 2025"
+ *
+ * A transform like encode() in hw1.cpp applies a pure step function many times,
+ * and after its first step every value lies in a small domain that the step
+ * maps into itself. So the result for every value in that domain can be worked
+ * out at compile time, and the run-time loop becomes a table lookup.
+ *
+ * Within a domain of SIZE values, any orbit repeats a value within SIZE steps
+ * and then cycles. The table builder records the step at which each value was
+ * first reached, and on the first repeat skips the whole remaining cycles. That
+ * keeps the build cost at O(SIZE) steps per entry whatever the iteration count.
+ */
+#pragma once
+
+/**
+ * @class IteratedTable - Step applied n times to every value in [LO, HI],
+ *                        computed at compile time
+ *
+ * @tparam Step - struct with static constexpr int apply(int), mapping [LO, HI]
+ *                into itself
+ */
+template <typename Step, long long ITERATIONS, int LO, int HI>
+struct IteratedTable {
+	static const int SIZE = HI - LO + 1;
+	int iterated[SIZE];   // Step^ITERATIONS(v) at [v - LO]
+	int afterFirst[SIZE]; // Step^(ITERATIONS - 1)(v) at [v - LO]
+
+	constexpr IteratedTable() : iterated(), afterFirst() {
+		for (int v = LO; v <= HI; v++) {
+			iterated[v - LO] = iterate(v, ITERATIONS);
+			afterFirst[v - LO] = iterate(v, ITERATIONS > 0 ? ITERATIONS - 1 : 0);
+		}
+	}
+
+	/**
+	 * Step^n(v) for v in [LO, HI], skipping whole cycles.
+	 */
+	static constexpr int iterate(int v, long long n) {
+		long long seen[SIZE] = {}; // step at which each value was first reached, plus one
+		long long i = 0;
+		for (; i < n && seen[v - LO] == 0; i++) {
+			seen[v - LO] = i + 1;
+			v = Step::apply(v);
+		}
+		if (i < n) {
+			long long cycle = i - (seen[v - LO] - 1);
+			for (long long remaining = (n - i) % cycle; remaining > 0; remaining--)
+				v = Step::apply(v);
+		}
+		return v;
+	}
+
+	/**
+	 * @return true if Step maps every value in [LO, HI] into [LO, HI]
+	 */
+	static constexpr bool closed() {
+		for (int v = LO; v <= HI; v++) {
+			int next = Step::apply(v);
+			if (next < LO || next > HI)
+				return false;
+		}
+		return true;
+	}
+};
+
+/**
+ * @class IteratedMap - Step applied ITERATIONS times, by table lookup
+ *
+ * Values in [LO, HI] are looked up directly. Any other value takes one real
+ * step, and if that lands in [LO, HI] the rest is looked up. Otherwise the
+ * loop runs as written, so results match the plain loop for every input.
+ *
+ * @tparam Step - struct with static constexpr int apply(int), mapping [LO, HI]
+ *                into itself
+ */
+template <typename Step, long long ITERATIONS, int LO, int HI>
+class IteratedMap {
+public:
+	typedef IteratedTable<Step, ITERATIONS, LO, HI> Table;
+	static_assert(Table::closed(), "Step must map [LO, HI] into itself");
+
+	/**
+	 * @return Step applied ITERATIONS times to v
+	 */
+	static int apply(int v) {
+		if (v >= LO && v <= HI)
+			return table.iterated[v - LO];
+		if (ITERATIONS == 0)
+			return v;
+		v = Step::apply(v);
+		if (v >= LO && v <= HI)
+			return table.afterFirst[v - LO];
+		return loop(v, ITERATIONS - 1);
+	}
+
+	/**
+	 * @return Step applied n times to v, one step at a time
+	 */
+	static int loop(int v, long long n) {
+		for (long long i = 0; i < n; i++)
+			v = Step::apply(v);
+		return v;
+	}
+
+private:
+	static constexpr Table table{};
+};
+
+template <typename Step, long long ITERATIONS, int LO, int HI>
+constexpr typename IteratedMap<Step, ITERATIONS, LO, HI>::Table IteratedMap<Step, ITERATIONS, LO, HI>::table;
@@ -10,14 +10,17 @@
  */
 #include "hw1.h"
 #include <iostream>
+#include "Encoder.h"
+#include "LargeArray.h"
 #include "ThreadGroup.h"
 using namespace std;
 
+const int NUM_THREADS = 2; // Use two threads for encoding and decoding
+
 int encode(int v) {
-    // do something time-consuming (and arbitrary)
-    for (int i = 0; i < 500; i++)
-        v = ((v * v) + v) % 10;
-    return v;
+    // do something time-consuming (and arbitrary): 500 steps, looked up in a
+    // table built at compile time
+    return Encoder::apply(v);
 }
 
 int decode(int v) {
@@ -106,7 +109,7 @@ public:
  * @param length Total number of elements in the array.
  */
 void prefixSums(int *data, int length) {
-    const int numThreads = 2; // Use two threads for encoding and decoding
+    const int numThreads = NUM_THREADS;
 
     // Set up shared data for threads
     ThreadData threadData = {};
@@ -141,20 +144,16 @@ void prefixSums(int *data, int length) {
 int main() {
     int length = 1000 * 1000; // Array size
 
-    // make array
-    int *data = new int[length];
-    for (int i = 1; i < length; i++)
-        data[i] = 1;
-    data[0] = 6;
+    // make array, each encoder thread first touching its own segment's pages
+    LargeArray<int> data(length);
+    data.firstTouch(NUM_THREADS, [](size_t i) { return i == 0 ? 6 : 1; });
 
     // transform array into converted/deconverted prefix sum of original
-    prefixSums(data, length);
+    prefixSums(data.data(), length);
 
     // printed out result is 6, 6, and 2 when data[0] is 6 to start and the rest 1
     cout << "[0]: " << data[0] << endl
             << "[" << length/2 << "]: " << data[length/2] << endl
             << "[end]: " << data[length-1] << endl;
-
-    delete[] data;
     return 0;
 }
@@ -0,0 +1,85 @@
+/**
+ * @file transform_check.cpp
+ * @brief Checks IteratedMap against the plain loop of hw1's encode() and times both.
+ * @see "Seattle University, CPSC5600, Winter 2025"
+ *
+ *     ./transform_check [range]
+ *
+ * Every value in the table's domain is checked for every iteration count up to
+ * 1000 (that one step lands every int in the domain is argued in Encoder.h), and
+ * every v in [-range, range] (default 100000, which takes in values whose first
+ * step wraps) against the 500-step loop. Then both are timed over
+ * the inputs hw1 decodes: the prefix sums of a million encoded values.
+ */
+#include <iostream>
+#include <string>
+#include <vector>
+#include "Encoder.h"
+#include "PerfCounters.h"
+using namespace std;
+
+int encodeLoop(int v) {
+    for (int i = 0; i < 500; i++)
+        v = (int)((unsigned)v * (unsigned)v + (unsigned)v) % 10;
+    return v;
+}
+
+/**
+ * Checks the compile-time cycle skipping against stepping, one count at a time.
+ */
+template <long long N>
+bool checkDomain() {
+    IteratedMap<EncodeStep, N, -9, 9> map;
+    for (int v = -9; v <= 9; v++)
+        if (map.apply(v) != Encoder::loop(v, N))
+            return false;
+    return true;
+}
+
+template <long long... NS>
+bool checkCounts() {
+    bool ok = true;
+    for (bool each : {checkDomain<NS>()...})
+        ok = ok && each;
+    return ok;
+}
+
+int main(int argc, char *argv[]) {
+    int range = argc > 1 ? stoi(argv[1]) : 100000;
+
+    bool domainOk = checkCounts<0, 1, 2, 3, 4, 5, 7, 10, 99, 500, 501, 1000>();
+    for (int v = -9; v <= 9; v++)
+        for (int n = 0; n <= 1000; n++)
+            domainOk = domainOk && Encoder::Table::iterate(v, n) == Encoder::loop(v, n);
+    long long mismatches = 0;
+    for (int v = -range; v <= range; v++)
+        mismatches += Encoder::apply(v) != encodeLoop(v);
+    cout << "domain " << (domainOk ? "ok" : "MISMATCH") << ", [" << -range << ", " << range << "] mismatches="
+         << mismatches << endl;
+
+    const int length = 1000 * 1000;
+    vector<int> sums(length);
+    int sum = 0;
+    for (int i = 0; i < length; i++) {
+        sum += Encoder::apply(i == 0 ? 6 : 1);
+        sums[i] = sum;
+    }
+    PerfRegion loopCounts("loop"), tableCounts("table");
+    long long looped = 0, tabled = 0;
+    {
+        PerfScope scope(loopCounts);
+        for (int v : sums)
+            looped += encodeLoop(v);
+    }
+    {
+        PerfScope scope(tableCounts);
+        for (int v : sums)
+            tabled += Encoder::apply(v);
+    }
+    double loopMs = loopCounts.total().seconds * 1000, tableMs = tableCounts.total().seconds * 1000;
+    cout << "loop ms=" << loopMs << " table ms=" << tableMs << " speedup=" << loopMs / tableMs
+         << " results " << (looped == tabled ? "match" : "DIFFER") << endl;
+    loopCounts.print(cout, length);
+    tableCounts.print(cout, length);
+    return domainOk && mismatches == 0 && looped == tabled ? 0 : 1;
+}
@@ -0,0 +1,471 @@
+/**
+ * @file AsyncRuntime.h - C++20 coroutine tasks scheduled on a TaskScheduler pool
+ * @see "Seattle University, CPSC 5005, Session 7"
+ *
+ * A Task<T> is a lazy coroutine that produces a T. Inside a task, co_await on
+ *   - another Task runs it inline on the same worker and resumes with its result,
+ *   - runtime.schedule() moves the rest of the task onto a pool worker,
+ *   - runtime.sleepFor(d) suspends for d without holding a worker,
+ *   - runtime.readFile(path, offset, size) suspends until the bytes are read.
+ *
+ * Suspended tasks hold no thread. Timers are kept by one timer thread and reads
+ * are made by one I/O thread; both hand the waiting task back to the pool as
+ * soon as it can continue. runtime.start(task) launches a task on the pool
+ * without waiting for it, so a read can be in flight while the caller computes,
+ * and a later co_await picks up its result (immediately if it has finished).
+ * runtime.blockOn(task) runs a task from ordinary code and waits for its result.
+ *
+ * Every task that is started must be awaited before it is destroyed, and every
+ * task must finish before the runtime is destroyed.
+ */
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <fcntl.h>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+#include "TaskScheduler.h"
+
+template <typename T = void>
+class Task;
+
+namespace detail {
+    /**
+     * Completion handshake shared by every Task: waiter holds nullptr while the
+     * task runs unawaited, the address of the coroutine awaiting it, or done()
+     * once it has finished. Whichever of finishing and awaiting comes second
+     * resumes the waiter.
+     */
+    struct PromiseBase {
+        std::atomic<void *> waiter{nullptr};
+        std::exception_ptr error;
+
+        static void *done() {
+            static char marker;
+            return &marker;
+        }
+
+        struct FinalAwaiter {
+            bool await_ready() noexcept {
+                return false;
+            }
+
+            template <typename P>
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<P> self) noexcept {
+                void *waiter = self.promise().waiter.exchange(done(), std::memory_order_acq_rel);
+                return waiter ? std::coroutine_handle<>::from_address(waiter) : std::noop_coroutine();
+            }
+
+            void await_resume() noexcept {
+            }
+        };
+
+        std::suspend_always initial_suspend() noexcept {
+            return {};
+        }
+
+        FinalAwaiter final_suspend() noexcept {
+            return {};
+        }
+
+        void unhandled_exception() {
+            error = std::current_exception();
+        }
+    };
+
+    template <typename T>
+    struct Promise : PromiseBase {
+        std::optional<T> value;
+
+        void return_value(T result) {
+            value.emplace(std::move(result));
+        }
+
+        T take() {
+            if (error)
+                std::rethrow_exception(error);
+            return std::move(*value);
+        }
+    };
+
+    template <>
+    struct Promise<void> : PromiseBase {
+        void return_void() {
+        }
+
+        void take() {
+            if (error)
+                std::rethrow_exception(error);
+        }
+    };
+
+    /**
+     * Fire-and-forget coroutine, used by blockOn to drive a task to completion.
+     */
+    struct Detached {
+        struct promise_type {
+            Detached get_return_object() {
+                return {};
+            }
+
+            std::suspend_never initial_suspend() noexcept {
+                return {};
+            }
+
+            std::suspend_never final_suspend() noexcept {
+                return {};
+            }
+
+            void return_void() {
+            }
+
+            void unhandled_exception() {
+                std::terminate();
+            }
+        };
+    };
+}
+
+/**
+ * @class Task - lazy coroutine producing a T, awaitable once
+ */
+template <typename T>
+class Task {
+public:
+    struct promise_type : detail::Promise<T> {
+        Task get_return_object() {
+            return Task(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+    };
+
+    Task(Task &&other) noexcept : coro(std::exchange(other.coro, nullptr)), started(other.started) {
+    }
+
+    Task &operator=(Task &&rhs) noexcept {
+        if (&rhs != this) {
+            if (coro)
+                coro.destroy();
+            coro = std::exchange(rhs.coro, nullptr);
+            started = rhs.started;
+        }
+        return *this;
+    }
+
+    ~Task() {
+        if (coro)
+            coro.destroy();
+    }
+
+    /**
+     * Suspends the awaiting coroutine until this task finishes: runs it inline
+     * if it has not been started, or waits for it if it has.
+     * @return the task's result (rethrows its exception)
+     */
+    auto operator co_await() noexcept {
+        return Awaiter<true>{this};
+    }
+
+    /**
+     * Like co_await on the task, but leaves the result in place for result().
+     */
+    auto completion() noexcept {
+        return Awaiter<false>{this};
+    }
+
+    /**
+     * @return the result of a finished task (rethrows its exception)
+     */
+    T result() {
+        return coro.promise().take();
+    }
+
+private:
+    std::coroutine_handle<promise_type> coro;
+    bool started = false;
+
+    explicit Task(std::coroutine_handle<promise_type> coro) : coro(coro) {
+    }
+
+    template <bool TAKE>
+    struct Awaiter {
+        Task *task;
+
+        bool await_ready() const noexcept {
+            return task->coro.promise().waiter.load(std::memory_order_acquire) == detail::PromiseBase::done();
+        }
+
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+            // once the waiter is published a started task may resume us and be destroyed, so look first
+            bool lazy = !task->started;
+            std::coroutine_handle<> coro = task->coro;
+            void *expected = nullptr;
+            if (!task->coro.promise().waiter.compare_exchange_strong(expected, awaiting.address(),
+                                                                     std::memory_order_acq_rel))
+                return awaiting;  // finished meanwhile
+            if (lazy) {
+                task->started = true;
+                return coro;
+            }
+            return std::noop_coroutine();
+        }
+
+        auto await_resume() {
+            if constexpr (TAKE)
+                return task->result();
+        }
+    };
+
+    friend class AsyncRuntime;
+};
+
+/**
+ * @class AsyncRuntime - timers, file reads and resumption for Tasks on a pool
+ */
+class AsyncRuntime {
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    /**
+     * @param pool      workers that run the tasks
+     * @param priority  TaskScheduler priority of every resumption
+     */
+    explicit AsyncRuntime(TaskScheduler &pool, int priority = TaskScheduler::NORMAL)
+            : pool(pool), priority(priority), timerThread(&AsyncRuntime::runTimers, this),
+              ioThread(&AsyncRuntime::runReads, this) {
+    }
+
+    ~AsyncRuntime() {
+        {
+            std::lock_guard<std::mutex> guard(timerLock);
+            stopping = true;
+        }
+        {
+            std::lock_guard<std::mutex> guard(ioLock);
+            ioStopping = true;
+        }
+        timerReady.notify_one();
+        ioReady.notify_one();
+        timerThread.join();
+        ioThread.join();
+    }
+
+    AsyncRuntime(const AsyncRuntime &other) = delete;
+    AsyncRuntime &operator=(const AsyncRuntime &rhs) = delete;
+
+    /**
+     * co_await to continue on a pool worker.
+     */
+    auto schedule() {
+        struct Awaiter {
+            AsyncRuntime *runtime;
+
+            bool await_ready() const noexcept {
+                return false;
+            }
+
+            void await_suspend(std::coroutine_handle<> awaiting) {
+                runtime->resume(awaiting);
+            }
+
+            void await_resume() const noexcept {
+            }
+        };
+        return Awaiter{this};
+    }
+
+    /**
+     * co_await to continue on a pool worker once the given time has passed.
+     */
+    template <typename Rep, typename Period>
+    auto sleepFor(std::chrono::duration<Rep, Period> delay) {
+        struct Awaiter {
+            AsyncRuntime *runtime;
+            Clock::time_point until;
+
+            bool await_ready() const noexcept {
+                return Clock::now() >= until;
+            }
+
+            void await_suspend(std::coroutine_handle<> awaiting) {
+                // this awaiter may be gone as soon as the timer is set
+                AsyncRuntime *owner = runtime;
+                {
+                    std::lock_guard<std::mutex> guard(owner->timerLock);
+                    owner->timers.emplace(until, awaiting);
+                }
+                owner->timerReady.notify_one();
+            }
+
+            void await_resume() const noexcept {
+            }
+        };
+        return Awaiter{this, Clock::now() + std::chrono::duration_cast<Clock::duration>(delay)};
+    }
+
+    /**
+     * co_await to read up to size bytes of a file from offset, continuing on a
+     * pool worker once they are read.
+     * @return the bytes read, fewer than size at the end of the file
+     * @throws std::system_error if the file cannot be opened or read
+     */
+    auto readFile(const std::string &path, off_t offset, size_t size) {
+        struct Awaiter {
+            AsyncRuntime *runtime;
+            Read read;
+
+            bool await_ready() const noexcept {
+                return false;
+            }
+
+            void await_suspend(std::coroutine_handle<> awaiting) {
+                // this awaiter may be gone as soon as the read is queued
+                AsyncRuntime *owner = runtime;
+                read.awaiting = awaiting;
+                {
+                    std::lock_guard<std::mutex> guard(owner->ioLock);
+                    owner->reads.push_back(&read);
+                }
+                owner->ioReady.notify_one();
+            }
+
+            std::vector<char> await_resume() {
+                if (read.errorNumber != 0)
+                    throw std::system_error(read.errorNumber, std::generic_category(), read.path);
+                return std::move(read.bytes);
+            }
+        };
+        return Awaiter{this, Read{path, offset, size, {}, 0, {}}};
+    }
+
+    /**
+     * Launches a task on the pool without waiting for it. The task must later
+     * be awaited.
+     */
+    template <typename T>
+    void start(Task<T> &task) {
+        task.started = true;
+        resume(task.coro);
+    }
+
+    /**
+     * Runs a task on the pool and blocks the calling thread until it finishes.
+     * Not to be called from a pool worker.
+     * @return the task's result (rethrows its exception)
+     */
+    template <typename T>
+    T blockOn(Task<T> task) {
+        Completion completion;
+        drive(task, completion);
+        std::unique_lock<std::mutex> guard(completion.lock);
+        completion.finished.wait(guard, [&completion] { return completion.done; });
+        return task.result();
+    }
+
+private:
+    struct Read {
+        std::string path;
+        off_t offset;
+        size_t size;
+        std::vector<char> bytes;
+        int errorNumber = 0;
+        std::coroutine_handle<> awaiting;
+    };
+
+    struct Completion {
+        std::mutex lock;
+        std::condition_variable finished;
+        bool done = false;
+    };
+
+    TaskScheduler &pool;
+    const int priority;
+    std::mutex timerLock;
+    std::condition_variable timerReady;
+    std::multimap<Clock::time_point, std::coroutine_handle<>> timers;
+    bool stopping = false;
+    std::mutex ioLock;
+    std::condition_variable ioReady;
+    std::deque<Read *> reads;
+    bool ioStopping = false;
+    std::thread timerThread;
+    std::thread ioThread;
+
+    void resume(std::coroutine_handle<> coro) {
+        pool.submit([coro] { coro.resume(); }, priority);
+    }
+
+    template <typename T>
+    detail::Detached drive(Task<T> &task, Completion &completion) {
+        co_await schedule();
+        co_await task.completion();
+        std::lock_guard<std::mutex> guard(completion.lock);
+        completion.done = true;
+        completion.finished.notify_one();
+    }
+
+    /**
+     * Timer thread routine: resumes each sleeper on the pool at its deadline.
+     */
+    void runTimers() {
+        std::unique_lock<std::mutex> guard(timerLock);
+        while (!stopping) {
+            if (timers.empty()) {
+                timerReady.wait(guard);
+            } else if (timers.begin()->first > Clock::now()) {
+                timerReady.wait_until(guard, timers.begin()->first);
+            } else {
+                resume(timers.begin()->second);
+                timers.erase(timers.begin());
+            }
+        }
+    }
+
+    /**
+     * I/O thread routine: makes each read in turn and resumes its reader on the
+     * pool.
+     */
+    void runReads() {
+        for (;;) {
+            Read *read;
+            {
+                std::unique_lock<std::mutex> guard(ioLock);
+                ioReady.wait(guard, [this] { return !reads.empty() || ioStopping; });
+                if (reads.empty())
+                    return;
+                read = reads.front();
+                reads.pop_front();
+            }
+            int fd = open(read->path.c_str(), O_RDONLY);
+            if (fd < 0) {
+                read->errorNumber = errno;
+            } else {
+                read->bytes.resize(read->size);
+                size_t total = 0;
+                while (total < read->size) {
+                    ssize_t got = pread(fd, read->bytes.data() + total, read->size - total, read->offset + total);
+                    if (got < 0 && errno == EINTR)
+                        continue;
+                    if (got < 0)
+                        read->errorNumber = errno;
+                    if (got <= 0)
+                        break;
+                    total += got;
+                }
+                read->bytes.resize(total);
+                close(fd);
+            }
+            resume(read->awaiting);
+        }
+    }
+};
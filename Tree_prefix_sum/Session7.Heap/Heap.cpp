@@ -13,10 +13,12 @@ Heap::Heap() {
     size = 0;
     capacity = INITIAL_CAPACITY;
     data = new int[capacity];
+    owned = true;
 }
 
 Heap::~Heap() {
-    delete[] data;
+    if (owned)
+        delete[] data;
 }
 
 Heap::Heap(const int *data, int size) {
@@ -25,6 +27,20 @@ Heap::Heap(const int *data, int size) {
     this->data = new int[capacity];
     for (int i = 0; i < size; i++)
         this->data[i] = data[i];
+    owned = true;
+    heapify();
+}
+
+Heap::Heap(int *storage, int size, bool inPlace) {
+    this->size = size;
+    capacity = size;
+    data = storage;
+    owned = !inPlace;
+    if (!inPlace) {
+        data = new int[capacity];
+        for (int i = 0; i < size; i++)
+            data[i] = storage[i];
+    }
     heapify();
 }
 
@@ -32,16 +48,19 @@ Heap::Heap(const Heap &other) {
     size = other.size;
     capacity = other.capacity;
     data = new int[capacity];
+    owned = true;
     for (int i = 0; i < size; i++)
         data[i] = other.data[i];
 }
 
 Heap & Heap::operator=(const Heap &rhs) {
     if (&rhs != this) {
-        delete[] data;
+        if (owned)
+            delete[] data;
         size = rhs.size;
         capacity = rhs.capacity;
         data = new int[capacity];
+        owned = true;
         for (int i = 0; i < size; i++)
             data[i] = rhs.data[i];
     }
@@ -55,6 +74,9 @@ void Heap::enqueue(int newItem) {
         data = new int[capacity];
         for (int i = 0; i < size; i++)
             data[i] = oldData[i];
+        if (owned)
+            delete[] oldData;
+        owned = true;
     }
     data[size++] = newItem;
     percolateUp(size - 1);
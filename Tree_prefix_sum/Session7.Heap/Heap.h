@@ -36,6 +36,18 @@ public:
      */
     Heap(const int *data, int size);
 
+    /**
+     * In-place constructor.
+     * Heapifies the caller's array and keeps the heap there, without copying,
+     * so it runs in whatever memory the caller chose (huge pages, say). The
+     * array must outlive the heap. Enqueueing past size moves the heap into
+     * storage of its own.
+     * @param storage  array of integers to heapify in place
+     * @param size     number of integers in storage
+     * @param inPlace  must be true; tells this apart from the copying constructor
+     */
+    Heap(int *storage, int size, bool inPlace);
+
     /**
      * Destructor.
      */
@@ -100,6 +112,7 @@ private:
     int size;
     int capacity;
     int *data;
+    bool owned;   // whether data was allocated here (false for in-place heaps)
 
     /**
      * The value at data[index] may violate the heap invariants by being too low.
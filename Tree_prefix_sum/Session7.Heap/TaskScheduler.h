@@ -0,0 +1,274 @@
+/**
+ * @file TaskScheduler.h - priority task scheduler over a pool of worker threads
+ * @see "Seattle University, CPSC 5005, Session 7"
+ *
+ * Unlike ThreadGroup, which runs one routine per thread in creation order, the
+ * scheduler keeps a fixed pool of workers and runs submitted tasks in order of
+ * urgency. Each worker has its own ready queue, a Heap of deadlines:
+ *
+ *     deadline = ticket + priority * agingTicks
+ *
+ * where ticket counts submissions. Priority 0 is the most urgent. A task of
+ * priority p is overtaken by later urgent tasks for only p * agingTicks further
+ * submissions; after that its deadline is the smallest and it runs. That is the
+ * aging that keeps background tasks from starving, and it needs no re-keying of
+ * queued tasks since every deadline is fixed at submission.
+ *
+ * Workers take the more urgent of their own next task and one peer's, and steal
+ * from any peer when their own heap is empty, so an urgent task does not wait
+ * behind a worker busy with a long one. Every rebalanceInterval tasks, one worker
+ * pulls every queued task out of every heap and deals them back out in deadline
+ * order, so each worker holds an even share of the urgent work.
+ */
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "Heap.h"
+
+/**
+ * @class TaskScheduler - runs submitted tasks on a pool of threads by priority
+ */
+class TaskScheduler {
+public:
+    typedef std::function<void()> Task;
+
+    /// Suggested priorities; any value in 0..LOWEST is allowed
+    enum Priority { URGENT = 0, NORMAL = 4, BACKGROUND = 8, LOWEST = 15 };
+
+    /**
+     * Starts the workers.
+     *
+     * @param workers            number of worker threads
+     * @param agingTicks         submissions per priority level before a waiting
+     *                           task counts as one level more urgent
+     * @param rebalanceInterval  tasks run between global rebalances
+     */
+    explicit TaskScheduler(int workers, int agingTicks = 64, int rebalanceInterval = 1024)
+            : agingTicks(agingTicks), rebalanceInterval(rebalanceInterval) {
+        for (int i = 0; i < std::max(workers, 1); i++)
+            pool.emplace_back(new Worker());
+        for (int i = 0; i < (int)pool.size(); i++)
+            pool[i]->thread = std::thread(&TaskScheduler::run, this, i);
+    }
+
+    /**
+     * Runs every task still queued, then stops the workers.
+     */
+    ~TaskScheduler() {
+        {
+            std::lock_guard<std::mutex> guard(idleLock);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto &worker : pool)
+            worker->thread.join();
+    }
+
+    TaskScheduler(const TaskScheduler &other) = delete;
+    TaskScheduler &operator=(const TaskScheduler &rhs) = delete;
+
+    /**
+     * Queues a task. Equal deadlines run in submission order.
+     *
+     * @param task      routine to run on some worker
+     * @param priority  0 (URGENT) .. LOWEST
+     */
+    void submit(Task task, int priority = NORMAL) {
+        priority = std::min(std::max(priority, 0), (int)LOWEST);
+        unfinished++;
+        long long ticket = tickets++;
+        Worker &worker = *pool[ticket % pool.size()];
+        {
+            std::lock_guard<std::mutex> guard(worker.lock);
+            push(worker, (int)(ticket + (long long)priority * agingTicks - epoch), std::move(task));
+        }
+        queued++;
+        {
+            std::lock_guard<std::mutex> guard(idleLock);
+        }
+        wake.notify_one();
+    }
+
+    /**
+     * Waits until every task submitted so far has finished.
+     */
+    void wait() {
+        std::unique_lock<std::mutex> guard(idleLock);
+        done.wait(guard, [this] { return unfinished == 0; });
+    }
+
+    /**
+     * @return number of workers
+     */
+    int size() const {
+        return (int)pool.size();
+    }
+
+    /**
+     * @return tasks a worker took from a peer's heap rather than its own
+     */
+    long long getSteals() const {
+        return steals;
+    }
+
+    /**
+     * @return global rebalances so far
+     */
+    long long getRebalances() const {
+        return rebalances;
+    }
+
+private:
+    struct Worker {
+        std::mutex lock;
+        Heap ready;                                      // deadline - epoch of each queued task
+        std::unordered_map<int, std::deque<Task>> tasks; // queued tasks by key, oldest first
+        int pending = 0;
+        std::thread thread;
+    };
+
+    const int agingTicks;
+    const int rebalanceInterval;
+    std::vector<std::unique_ptr<Worker>> pool;
+    std::atomic<long long> tickets{0};
+    long long epoch = 0;              // subtracted from deadlines to fit a Heap int; changed with every lock held
+    std::atomic<int> queued{0};      // tasks in some heap
+    std::atomic<int> unfinished{0};  // tasks queued or running
+    std::atomic<long long> dispatched{0};
+    std::atomic<long long> steals{0};
+    std::atomic<long long> rebalances{0};
+    std::atomic<unsigned> peerTurn{0};
+    std::mutex idleLock;
+    std::condition_variable wake;
+    std::condition_variable done;
+    bool stopping = false;
+
+    static void push(Worker &worker, int key, Task task) {
+        worker.ready.enqueue(key);
+        worker.tasks[key].push_back(std::move(task));
+        worker.pending++;
+    }
+
+    static Task pop(Worker &worker, int &key) {
+        key = worker.ready.dequeue();
+        auto equal = worker.tasks.find(key);
+        Task task = std::move(equal->second.front());
+        equal->second.pop_front();
+        if (equal->second.empty())
+            worker.tasks.erase(equal);
+        worker.pending--;
+        return task;
+    }
+
+    /**
+     * Worker thread routine: take, run, occasionally rebalance, until stopped
+     * with nothing queued.
+     */
+    void run(int index) {
+        for (;;) {
+            Task task;
+            if (!take(index, task)) {
+                std::unique_lock<std::mutex> guard(idleLock);
+                wake.wait(guard, [this] { return queued > 0 || stopping; });
+                if (stopping && queued == 0)
+                    return;
+                continue;
+            }
+            task();
+            if (++dispatched % rebalanceInterval == 0)
+                rebalance();
+            if (--unfinished == 0) {
+                std::lock_guard<std::mutex> guard(idleLock);
+                done.notify_all();
+            }
+        }
+    }
+
+    /**
+     * Takes the more urgent of this worker's next task and a peer's, or steals
+     * from any peer if this worker has none.
+     *
+     * @return false if no task was found
+     */
+    bool take(int index, Task &task) {
+        int n = (int)pool.size(), key;
+        Worker &own = *pool[index];
+        {
+            std::lock_guard<std::mutex> guard(own.lock);
+            if (n > 1 && own.pending > 0) {
+                Worker &peer = *pool[(index + 1 + peerTurn++ % (n - 1)) % n];
+                std::unique_lock<std::mutex> peerGuard(peer.lock, std::try_to_lock);
+                if (peerGuard.owns_lock() && peer.pending > 0 && peer.ready.peek() < own.ready.peek()) {
+                    task = pop(peer, key);
+                    steals++;
+                    queued--;
+                    return true;
+                }
+            }
+            if (own.pending > 0) {
+                task = pop(own, key);
+                queued--;
+                return true;
+            }
+        }
+        for (int i = 1; i < n; i++) {
+            Worker &peer = *pool[(index + i) % n];
+            std::lock_guard<std::mutex> guard(peer.lock);
+            if (peer.pending > 0) {
+                task = pop(peer, key);
+                steals++;
+                queued--;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * Pulls every queued task out of every heap and deals them back out in
+     * deadline order, then moves the epoch up to the earliest deadline so the
+     * keys stay small.
+     */
+    void rebalance() {
+        std::vector<std::unique_lock<std::mutex>> guards;
+        for (auto &worker : pool)
+            guards.emplace_back(worker->lock);
+
+        std::vector<std::pair<long long, Task>> all;
+        for (auto &worker : pool) {
+            int key;
+            while (worker->pending > 0) {
+                Task task = pop(*worker, key);
+                all.emplace_back(key + epoch, std::move(task));
+            }
+        }
+        // each heap drains in order, so a stable sort keeps submission order among equal deadlines
+        std::stable_sort(all.begin(), all.end(),
+                         [](const std::pair<long long, Task> &a, const std::pair<long long, Task> &b) {
+                             return a.first < b.first;
+                         });
+        epoch = all.empty() ? tickets.load() : std::min(all.front().first, tickets.load());
+
+        int n = (int)pool.size();
+        std::vector<std::vector<int>> keys(n);
+        for (int i = 0; i < (int)all.size(); i++) {
+            Worker &worker = *pool[i % n];
+            int key = (int)(all[i].first - epoch);
+            keys[i % n].push_back(key);
+            worker.tasks[key].push_back(std::move(all[i].second));
+            worker.pending++;
+        }
+        for (int w = 0; w < n; w++)
+            pool[w]->ready = keys[w].empty() ? Heap() : Heap(keys[w].data(), (int)keys[w].size());
+        rebalances++;
+    }
+};
@@ -0,0 +1,157 @@
+/**
+ * @file async_pipeline.cpp - overlapping file reads with compute using AsyncRuntime
+ * @see "Seattle University, CPSC 5005, Session 7"
+ *
+ *     ./async_pipeline file [chunk_kb] [rounds] [workers]
+ *
+ * Hashes a file chunk by chunk, rounds passes over each chunk, twice: first with
+ * blocking reads, reading and hashing in turn on one thread, then as a coroutine
+ * on AsyncRuntime that starts the read of the next chunk before hashing the
+ * current one, so reading and hashing overlap without a thread blocked on the
+ * read. A heartbeat coroutine wakes every 5 ms during the second run to show that
+ * timers keep running alongside. The file is dropped from the page cache before
+ * each run so the reads go to the device. Both runs must agree on the hash, and
+ * must also agree on an empty file made for the check.
+ */
+
+#include <chrono>
+#include <fcntl.h>
+#include <iostream>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+#include "AsyncRuntime.h"
+
+using namespace std;
+typedef chrono::steady_clock Clock;
+
+/**
+ * FNV-1a over the chunk, rounds times, standing in for real per-chunk work.
+ */
+unsigned long long hashChunk(const vector<char> &bytes, int rounds) {
+    unsigned long long hash = 14695981039346656037ull;
+    for (int r = 0; r < rounds; r++)
+        for (char c : bytes) {
+            hash ^= (unsigned char)c;
+            hash *= 1099511628211ull;
+        }
+    return hash;
+}
+
+unsigned long long combine(unsigned long long total, unsigned long long chunk) {
+    return total * 31 + chunk;
+}
+
+void dropCache(const string &path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd >= 0) {
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        close(fd);
+    }
+}
+
+unsigned long long blockingHash(const string &path, off_t size, size_t chunk, int rounds) {
+    unsigned long long total = 0;
+    int fd = open(path.c_str(), O_RDONLY);
+    vector<char> bytes;
+    for (off_t offset = 0; offset < size; offset += chunk) {
+        bytes.resize(min((off_t)chunk, size - offset));
+        if (pread(fd, bytes.data(), bytes.size(), offset) != (ssize_t)bytes.size())
+            bytes.clear();
+        total = combine(total, hashChunk(bytes, rounds));
+    }
+    close(fd);
+    return total;
+}
+
+Task<vector<char>> readChunk(AsyncRuntime &runtime, string path, off_t offset, size_t size) {
+    co_return co_await runtime.readFile(path, offset, size);
+}
+
+Task<unsigned long long> pipelinedHash(AsyncRuntime &runtime, string path, off_t size, size_t chunk, int rounds) {
+    unsigned long long total = 0;
+    if (size == 0)
+        co_return total;  // nothing to read, and a started read must be awaited
+    Task<vector<char>> next = readChunk(runtime, path, 0, chunk);
+    runtime.start(next);
+    for (off_t offset = 0; offset < size; offset += chunk) {
+        vector<char> bytes = co_await next;
+        if (offset + (off_t)chunk < size) {
+            next = readChunk(runtime, path, offset + chunk, chunk);
+            runtime.start(next);
+        }
+        total = combine(total, hashChunk(bytes, rounds));
+    }
+    co_return total;
+}
+
+Task<int> heartbeat(AsyncRuntime &runtime, const atomic<bool> &stop) {
+    int beats = 0;
+    while (!stop) {
+        co_await runtime.sleepFor(chrono::milliseconds(5));
+        beats++;
+    }
+    co_return beats;
+}
+
+Task<unsigned long long> pipelineWithHeartbeat(AsyncRuntime &runtime, string path, off_t size, size_t chunk,
+                                               int rounds, int &beats) {
+    atomic<bool> stop(false);
+    Task<int> pulse = heartbeat(runtime, stop);
+    runtime.start(pulse);
+    unsigned long long total = co_await pipelinedHash(runtime, path, size, chunk, rounds);
+    stop = true;
+    beats = co_await pulse;
+    co_return total;
+}
+
+double millisSince(Clock::time_point start) {
+    return chrono::duration<double, milli>(Clock::now() - start).count();
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        cerr << "usage: ./async_pipeline file [chunk_kb] [rounds] [workers]" << endl;
+        return EXIT_FAILURE;
+    }
+    string path = argv[1];
+    size_t chunk = (argc > 2 ? stoul(argv[2]) : 1024) * 1024;
+    int rounds = argc > 3 ? stoi(argv[3]) : 4;
+    int workers = argc > 4 ? stoi(argv[4]) : 2;
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0) {
+        cerr << "cannot stat " << path << endl;
+        return EXIT_FAILURE;
+    }
+    off_t size = info.st_size;
+
+    dropCache(path);
+    Clock::time_point start = Clock::now();
+    unsigned long long blocking = blockingHash(path, size, chunk, rounds);
+    double blockingMs = millisSince(start);
+
+    TaskScheduler pool(workers);
+    AsyncRuntime runtime(pool);
+    dropCache(path);
+    int beats = 0;
+    start = Clock::now();
+    unsigned long long pipelined = runtime.blockOn(pipelineWithHeartbeat(runtime, path, size, chunk, rounds, beats));
+    double pipelinedMs = millisSince(start);
+
+    char emptyPath[] = "/tmp/async_pipeline_XXXXXX";
+    int emptyFd = mkstemp(emptyPath);
+    bool emptyOk = emptyFd >= 0
+        && runtime.blockOn(pipelinedHash(runtime, emptyPath, 0, chunk, rounds)) == blockingHash(emptyPath, 0, chunk, rounds);
+    if (emptyFd >= 0) {
+        close(emptyFd);
+        unlink(emptyPath);
+    }
+
+    cout << "bytes=" << size << " chunk_kb=" << chunk / 1024 << " rounds=" << rounds << endl;
+    cout << "blocking ms=" << blockingMs << endl;
+    cout << "pipelined ms=" << pipelinedMs << " workers=" << pool.size() << " heartbeats=" << beats
+         << " hash_matches=" << (blocking == pipelined ? "yes" : "no") << endl;
+    cout << "empty file hash_matches=" << (emptyOk ? "yes" : "no") << endl;
+    return blocking == pipelined && emptyOk ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -3,8 +3,14 @@
 // Seattle University, CPSC 5005, Session 7
 //
 
+#include <chrono>
 #include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
 #include "Heap.h"
+#include "LargeArray.h"
+#include "PerfCounters.h"
 using namespace std;
 
 string tf(bool cond) {
@@ -48,19 +54,19 @@ void drain(Heap heap) {
 }
 
 void heapifyTest(int size, int range) {
-    int data[size];
+    vector<int> data(size);
     for (int i = 0; i < size; i++)
         data[i] = rand() % range;
-    Heap heap(data, size);
+    Heap heap(data.data(), size);
     cout << "Heapify test: " << (heap.isValid() ? "valid" : "INVALID") << endl;
     drain(heap);
 }
 
 void heapsortTest(int size, int range, bool print) {
-    int data[size];
+    vector<int> data(size);
     for (int i = 0; i < size; i++)
         data[i] = rand() % range;
-    Heap::heapsort(data, size);
+    Heap::heapsort(data.data(), size);
     if (print) {
         cout << "sorted: " << endl;
         for (int i = 0; i < size; i++)
@@ -69,22 +75,43 @@ void heapsortTest(int size, int range, bool print) {
     }
 }
 
-int main() {
+int main(int argc, char *argv[]) {
     srand(time(nullptr));
     randomTest(400, 100);
     heapifyTest(1000, 100);
     heapsortTest(50, 100, true);
 
-    /* FIXME: do timing in C++ like in this Java version
-     * FIXME: this would also require resize() with dynamic array
-    long start = System.nanoTime();
-    for (int n = 5_000; n < 100_000_000; n *= 2) {
-        heapsortTest(n, 100, false);
-        long end = System.nanoTime();
-        System.out.println(n + ": " + (end - start) / 1000_000_000.0);
-        start = end;
+    // heapsort timing up to the size given on the command line, with the
+    // heapify and the dequeues (percolateDown) counted separately
+    // The heap works in place in the LargeArray, which this thread touches
+    // first, so its pages are huge pages on this thread's node
+    int largest = argc > 1 ? stoi(argv[1]) : 0;
+    for (int n = 5000; n < largest; n *= 2) {
+        LargeArray<int> data(n);
+        for (int i = 0; i < n; i++)
+            data[i] = rand() % 100;
+        PerfRegion heapify("heapify " + to_string(n)), drain("dequeue " + to_string(n));
+        auto start = chrono::steady_clock::now();
+        unique_ptr<Heap> heap;
+        {
+            PerfScope scope(heapify);
+            heap.reset(new Heap(data.data(), n, true));
+        }
+        bool sorted = true;
+        {
+            PerfScope scope(drain);
+            int prev = heap->peek();
+            for (int i = 0; i < n; i++) {
+                int next = heap->dequeue();
+                sorted = sorted && prev <= next;
+                prev = next;
+            }
+        }
+        chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+        cout << n << ": " << elapsed.count() << (sorted ? "" : " out of order FAIL!!") << endl;
+        heapify.print(cout, n);
+        drain.print(cout, n);
     }
-    */
 
     return EXIT_SUCCESS;
 }
@@ -0,0 +1,121 @@
+/**
+ * @file scheduler_benchmark.cpp - tail latency of urgent tasks under background load
+ * @see "Seattle University, CPSC 5005, Session 7"
+ *
+ *     ./scheduler_benchmark [workers] [seconds] [background_us] [urgent_us] [backlog]
+ *
+ * The main thread keeps the TaskScheduler saturated with background tasks, each
+ * spinning for background_us, so that about backlog of them are always queued.
+ * Meanwhile a second thread submits a short urgent task every millisecond. The
+ * run is made twice: first with every task at the same priority, which runs them
+ * in submission order like a plain FIFO pool, and then with the urgent tasks at
+ * URGENT and the rest at BACKGROUND. For each run the report gives percentiles of
+ * the urgent tasks' submit-to-finish latency, and the longest any background task
+ * waited to start, which aging keeps bounded.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "TaskScheduler.h"
+
+using namespace std;
+typedef chrono::steady_clock Clock;
+
+/**
+ * Busy-waits for the given time, standing in for real work.
+ */
+void spin(int micros) {
+    Clock::time_point until = Clock::now() + chrono::microseconds(micros);
+    while (Clock::now() < until)
+        ;
+}
+
+double microsSince(Clock::time_point start) {
+    return chrono::duration<double, micro>(Clock::now() - start).count();
+}
+
+/**
+ * Raises most to value if value is larger.
+ */
+void raise(atomic<double> &most, double value) {
+    double seen = most;
+    while (value > seen && !most.compare_exchange_weak(seen, value))
+        ;
+}
+
+double percentile(vector<double> &sorted, double p) {
+    if (sorted.empty())
+        return 0;
+    return sorted[min(sorted.size() - 1, (size_t)(p * sorted.size()))];
+}
+
+void runMode(const string &mode, bool prioritized, int workers, int seconds, int backgroundUs, int urgentUs,
+             int backlog) {
+    const int MAX_URGENT = seconds * 1000 + 1;
+    vector<double> latencies(MAX_URGENT);
+    atomic<int> urgentDone(0), outstanding(0);
+    atomic<double> backgroundWait(0);
+    atomic<bool> running(true);
+    long long backgroundRun = 0;
+    {
+        TaskScheduler scheduler(workers);
+        thread urgent([&] {
+            for (int i = 0; i < MAX_URGENT && running; i++) {
+                Clock::time_point submitted = Clock::now();
+                scheduler.submit([&, i, submitted] {
+                    spin(urgentUs);
+                    latencies[i] = microsSince(submitted);
+                    urgentDone++;
+                }, prioritized ? TaskScheduler::URGENT : TaskScheduler::NORMAL);
+                this_thread::sleep_for(chrono::milliseconds(1));
+            }
+        });
+
+        Clock::time_point start = Clock::now();
+        while (microsSince(start) < seconds * 1e6) {
+            if (outstanding < backlog) {
+                Clock::time_point submitted = Clock::now();
+                outstanding++;
+                backgroundRun++;
+                scheduler.submit([&, submitted] {
+                    raise(backgroundWait, microsSince(submitted));
+                    spin(backgroundUs);
+                    outstanding--;
+                }, prioritized ? TaskScheduler::BACKGROUND : TaskScheduler::NORMAL);
+            } else {
+                this_thread::sleep_for(chrono::microseconds(100));
+            }
+        }
+        running = false;
+        urgent.join();
+        scheduler.wait();
+        cout << mode << " workers=" << scheduler.size() << " steals=" << scheduler.getSteals()
+             << " rebalances=" << scheduler.getRebalances();
+    }
+
+    latencies.resize(urgentDone);
+    sort(latencies.begin(), latencies.end());
+    cout << " background_tasks=" << backgroundRun << " urgent_tasks=" << latencies.size()
+         << " urgent_p50_us=" << percentile(latencies, 0.50)
+         << " urgent_p99_us=" << percentile(latencies, 0.99)
+         << " urgent_p999_us=" << percentile(latencies, 0.999)
+         << " urgent_max_us=" << (latencies.empty() ? 0 : latencies.back())
+         << " background_max_wait_us=" << backgroundWait << endl;
+}
+
+int main(int argc, char *argv[]) {
+    int workers = argc > 1 ? stoi(argv[1]) : max(2, (int)thread::hardware_concurrency());
+    int seconds = argc > 2 ? stoi(argv[2]) : 2;
+    int backgroundUs = argc > 3 ? stoi(argv[3]) : 200;
+    int urgentUs = argc > 4 ? stoi(argv[4]) : 20;
+    int backlog = argc > 5 ? stoi(argv[5]) : 32 * workers;
+
+    runMode("fifo", false, workers, seconds, backgroundUs, urgentUs, backlog);
+    runMode("priority", true, workers, seconds, backgroundUs, urgentUs, backlog);
+    return EXIT_SUCCESS;
+}